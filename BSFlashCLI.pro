@@ -0,0 +1,65 @@
+QT += core concurrent
+QT -= gui
+
+TARGET = bsflash-cli
+TEMPLATE = app
+CONFIG += console c99 c++11
+CONFIG -= app_bundle
+
+CONFIG(debug, debug|release) {
+    DESTDIR = debug
+}
+CONFIG(release, debug|release) {
+    DESTDIR = release
+}
+
+OBJECTS_DIR = obj/cli/$$DESTDIR
+MOC_DIR = $$OBJECTS_DIR
+RCC_DIR = $$OBJECTS_DIR
+
+INCLUDEPATH += src
+
+# build on OS X with xcode/clang and libc++
+macx:QMAKE_CXXFLAGS += -stdlib=libc++
+
+LIBS += -L$$DESTDIR -llibusb-1.0
+
+HEADERS += \
+    src/blockindex.h \
+    src/blockmap.h \
+    src/blockscan.h \
+    src/crc32.h \
+    src/dumphasher.h \
+    src/dumpqueue.h \
+    src/dumpthread.h \
+    src/dumpwriter.h \
+    src/endian.h \
+    src/mempackexport.h \
+    src/mempackitem.h \
+    src/mempackloader.h \
+    src/packcontainer.h \
+    src/packimage.h \
+    src/packstore.h \
+    src/usb/device.h \
+    src/usb/inlretro.h \
+    src/zipwriter.h
+
+SOURCES += \
+    src/blockindex.cpp \
+    src/blockmap.cpp \
+    src/blockscan.cpp \
+    src/cli/main.cpp \
+    src/crc32.cpp \
+    src/dumphasher.cpp \
+    src/dumpqueue.cpp \
+    src/dumpthread.cpp \
+    src/dumpwriter.cpp \
+    src/mempackexport.cpp \
+    src/mempackitem.cpp \
+    src/mempackloader.cpp \
+    src/packcontainer.cpp \
+    src/packimage.cpp \
+    src/packstore.cpp \
+    src/usb/device.cpp \
+    src/usb/inlretro.cpp \
+    src/zipwriter.cpp
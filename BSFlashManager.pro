@@ -1,4 +1,4 @@
-QT += core widgets
+QT += core concurrent widgets
 
 TARGET = BSFlashManager
 TEMPLATE = app
@@ -32,19 +32,47 @@ FORMS += \
     src/usbdump.ui
 
 HEADERS += \
+    src/blockindex.h \
+    src/blockmap.h \
+    src/blockscan.h \
+    src/crc32.h \
+    src/dumphasher.h \
+    src/dumpqueue.h \
+    src/dumpthread.h \
+    src/dumpwriter.h \
     src/endian.h \
     src/mainwindow.h \
+    src/mempackexport.h \
     src/mempackitem.h \
+    src/mempackloader.h \
     src/mempackmodel.h \
+    src/packcontainer.h \
+    src/packimage.h \
+    src/packlayout.h \
     src/usb/device.h \
     src/usb/inlretro.h \
-    src/usbdump.h
+    src/usbdump.h \
+    src/zipwriter.h
 
 SOURCES += \
+    src/blockindex.cpp \
+    src/blockmap.cpp \
+    src/blockscan.cpp \
+    src/crc32.cpp \
+    src/dumphasher.cpp \
+    src/dumpqueue.cpp \
+    src/dumpthread.cpp \
+    src/dumpwriter.cpp \
     src/main.cpp \
     src/mainwindow.cpp \
+    src/mempackexport.cpp \
     src/mempackitem.cpp \
+    src/mempackloader.cpp \
     src/mempackmodel.cpp \
+    src/packcontainer.cpp \
+    src/packimage.cpp \
+    src/packlayout.cpp \
     src/usb/device.cpp \
     src/usb/inlretro.cpp \
-    src/usbdump.cpp
+    src/usbdump.cpp \
+    src/zipwriter.cpp
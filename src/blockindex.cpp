@@ -0,0 +1,191 @@
+#include "blockindex.h"
+#include "blockscan.h"
+
+#include <qcryptographichash.h>
+#include <qdatastream.h>
+#include <qsavefile.h>
+#include <cstring>
+
+static const quint32 indexMagic = 0x58495342; // "BSIX"
+static const quint32 indexVersion = 1;
+
+// ----------------------------------------------------------------------------
+bool BlockIndex::load(const QString &path)
+{
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		error = file.errorString();
+		return false;
+	}
+
+	QDataStream in(&file);
+	in.setVersion(QDataStream::Qt_5_0);
+
+	quint32 magic, version, numFiles, numBlocks;
+	in >> magic >> version;
+	if (magic != indexMagic || version != indexVersion)
+	{
+		error = QString("%1 is not a block index.").arg(path);
+		return false;
+	}
+
+	files.clear();
+	fileHashes.clear();
+	blocks.clear();
+
+	in >> numFiles;
+	files.reserve(numFiles);
+	for (quint32 i = 0; i < numFiles && in.status() == QDataStream::Ok; i++)
+	{
+		QByteArray header;
+		quint32 numFileBlocks;
+		File entry;
+		in >> header >> numFileBlocks >> entry.hash;
+
+		memset(&entry.header, 0, sizeof entry.header);
+		memcpy(&entry.header, header.constData(), qMin<size_t>(header.size(), sizeof entry.header));
+		entry.blocks = numFileBlocks;
+		files.append(entry);
+		fileHashes.insert(entry.hash);
+	}
+
+	in >> numBlocks;
+	blocks.reserve(numBlocks);
+	for (quint32 i = 0; i < numBlocks && in.status() == QDataStream::Ok; i++)
+	{
+		QByteArray hash;
+		quint32 fileNum, block;
+		in >> hash >> fileNum >> block;
+
+		if (fileNum < (quint32)files.size())
+		{
+			blocks.insert(hash, { (int)fileNum, block });
+		}
+	}
+
+	if (in.status() != QDataStream::Ok)
+	{
+		error = QString("%1 is truncated or corrupted.").arg(path);
+		return false;
+	}
+
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+bool BlockIndex::save(const QString &path) const
+{
+	QSaveFile file(path);
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		error = file.errorString();
+		return false;
+	}
+
+	QDataStream out(&file);
+	out.setVersion(QDataStream::Qt_5_0);
+
+	out << indexMagic << indexVersion;
+
+	out << (quint32)files.size();
+	for (const File &entry : files)
+	{
+		out << QByteArray((const char*)&entry.header, sizeof entry.header)
+		    << (quint32)entry.blocks << entry.hash;
+	}
+
+	out << (quint32)blocks.size();
+	for (auto i = blocks.constBegin(); i != blocks.constEnd(); i++)
+	{
+		out << i.key() << (quint32)i.value().file << (quint32)i.value().block;
+	}
+
+	if (!file.commit())
+	{
+		error = file.errorString();
+		return false;
+	}
+
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+QString BlockIndex::errorString() const
+{
+	return error;
+}
+
+// ----------------------------------------------------------------------------
+int BlockIndex::addItems(const MemPackItems &items)
+{
+	int added = 0;
+
+	for (MemPackItem item : items)
+	{
+		// only index files that are known to be intact (checking them now if that hasn't happened yet)
+		if (item.integrity == MemPackItem::Unchecked) item.validate();
+		if (item.placeholder || item.deleted || item.integrity != MemPackItem::ChecksumOK) continue;
+
+		const QByteArray data = item.dataView();
+		const QByteArray fileHash = QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+
+		if (fileHashes.contains(fileHash)) continue;
+
+		const int fileNum = files.size();
+		files.append({ item.header, item.blocks, fileHash });
+		fileHashes.insert(fileHash);
+		added++;
+
+		for (unsigned block = 0; block < item.blocks; block++)
+		{
+			const char *blockData = data.constData() + (block << 17);
+
+			// erased padding blocks look the same in every file, and never end up as leftovers anyway
+			if (isErased(blockData, 1 << 17)) continue;
+
+			// if the same block appears in more than one file, keep the first one
+			const QByteArray hash = hashBlock(blockData);
+			if (!blocks.contains(hash))
+			{
+				blocks.insert(hash, { fileNum, block });
+			}
+		}
+	}
+
+	return added;
+}
+
+// ----------------------------------------------------------------------------
+int BlockIndex::fileCount() const
+{
+	return files.size();
+}
+
+// ----------------------------------------------------------------------------
+int BlockIndex::blockCount() const
+{
+	return blocks.size();
+}
+
+// ----------------------------------------------------------------------------
+const BlockIndex::File& BlockIndex::file(int num) const
+{
+	return files[num];
+}
+
+// ----------------------------------------------------------------------------
+bool BlockIndex::lookup(const QByteArray &blockHash, Location *location) const
+{
+	auto i = blocks.constFind(blockHash);
+	if (i == blocks.constEnd()) return false;
+
+	if (location) *location = i.value();
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+QByteArray BlockIndex::hashBlock(const char *data)
+{
+	return QCryptographicHash::hash(QByteArray::fromRawData(data, 1 << 17), QCryptographicHash::Sha1);
+}
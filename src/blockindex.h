@@ -0,0 +1,48 @@
+#pragma once
+
+#include <qbytearray.h>
+#include <qhash.h>
+#include <qset.h>
+#include <qvector.h>
+#include "mempackitem.h"
+
+// Index of the 128 KB blocks of known files, keyed by SHA-1, for identifying
+// leftover data whose header block has since been overwritten.
+class BlockIndex
+{
+public:
+	// where a block was seen: which file, and which block of that file
+	struct Location
+	{
+		int file;
+		unsigned block;
+	};
+
+	struct File
+	{
+		ItemHeader header;
+		unsigned blocks;
+		QByteArray hash; // SHA-1 of the whole file, so the same file isn't indexed twice
+	};
+
+	bool load(const QString &path);
+	bool save(const QString &path) const;
+	QString errorString() const;
+
+	// adds the blocks of every intact file from a loaded pack; returns the number of new files
+	int addItems(const MemPackItems &items);
+
+	int fileCount() const;
+	int blockCount() const;
+	const File& file(int num) const;
+
+	bool lookup(const QByteArray &blockHash, Location *location) const;
+
+	static QByteArray hashBlock(const char *data);
+
+private:
+	QVector<File> files;
+	QSet<QByteArray> fileHashes;
+	QHash<QByteArray, Location> blocks;
+	mutable QString error;
+};
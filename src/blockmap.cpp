@@ -0,0 +1,219 @@
+#include "blockmap.h"
+
+#include <qalgorithms.h>
+
+// ----------------------------------------------------------------------------
+BlockMap::BlockMap(unsigned size)
+	: words((size + 63) / 64, 0)
+	, bits(size)
+{
+
+}
+
+// ----------------------------------------------------------------------------
+BlockMap BlockMap::fromHeader(quint32 mask, unsigned headerBlock, unsigned totalBlocks)
+{
+	// smaller packs mirror the upper bits of the mask onto the lower ones
+	// (e.g. a file in blocks 8-9 of an 8-block pack is really in blocks 0-1)
+	quint32 keep = 0xffffffff;
+	unsigned shift = 16;
+	while (shift && totalBlocks <= shift)
+	{
+		mask |= (mask >> shift);
+		keep >>= shift;
+		shift >>= 1;
+	}
+	mask &= keep;
+
+	BlockMap map(totalBlocks);
+	const unsigned base = headerBlock & ~31;
+	while (mask)
+	{
+		const unsigned block = base + qCountTrailingZeroBits(mask);
+		if (block < totalBlocks)
+		{
+			map.set(block);
+		}
+		mask &= mask - 1;
+	}
+
+	return map;
+}
+
+// ----------------------------------------------------------------------------
+quint32 BlockMap::toHeader(unsigned firstBlock) const
+{
+	const unsigned base = firstBlock & ~31;
+	quint32 mask = 0;
+
+	for (int block = findFirstSet(base); block >= 0 && (unsigned)block < base + 32; block = findFirstSet(block + 1))
+	{
+		mask |= 1u << (block - base);
+	}
+
+	return mask;
+}
+
+// ----------------------------------------------------------------------------
+unsigned BlockMap::size() const
+{
+	return bits;
+}
+
+// ----------------------------------------------------------------------------
+void BlockMap::resize(unsigned size)
+{
+	words.resize((size + 63) / 64);
+	bits = size;
+	clearUnused();
+}
+
+// ----------------------------------------------------------------------------
+bool BlockMap::test(unsigned block) const
+{
+	if (block >= bits) return false;
+	return words[block / 64] & (Q_UINT64_C(1) << (block % 64));
+}
+
+// ----------------------------------------------------------------------------
+void BlockMap::set(unsigned block, bool value)
+{
+	if (block >= bits)
+	{
+		if (!value) return;
+		resize(block + 1);
+	}
+
+	const quint64 bit = Q_UINT64_C(1) << (block % 64);
+	if (value)
+	{
+		words[block / 64] |= bit;
+	}
+	else
+	{
+		words[block / 64] &= ~bit;
+	}
+}
+
+// ----------------------------------------------------------------------------
+void BlockMap::setRange(unsigned first, unsigned count, bool value)
+{
+	for (unsigned i = first; i < first + count; i++)
+	{
+		set(i, value);
+	}
+}
+
+// ----------------------------------------------------------------------------
+unsigned BlockMap::count() const
+{
+	unsigned total = 0;
+	for (quint64 word : words)
+	{
+		total += qPopulationCount(word);
+	}
+	return total;
+}
+
+// ----------------------------------------------------------------------------
+bool BlockMap::isEmpty() const
+{
+	for (quint64 word : words)
+	{
+		if (word) return false;
+	}
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+int BlockMap::findFirstSet(unsigned from) const
+{
+	if (from >= bits) return -1;
+
+	unsigned index = from / 64;
+	quint64 word = words[index] & (~Q_UINT64_C(0) << (from % 64));
+
+	while (true)
+	{
+		if (word)
+		{
+			return index * 64 + qCountTrailingZeroBits(word);
+		}
+		if (++index >= (unsigned)words.size()) return -1;
+		word = words[index];
+	}
+}
+
+// ----------------------------------------------------------------------------
+int BlockMap::findFirstClear(unsigned from) const
+{
+	if (from >= bits) return -1;
+
+	unsigned index = from / 64;
+	quint64 word = ~words[index] & (~Q_UINT64_C(0) << (from % 64));
+
+	while (true)
+	{
+		if (word)
+		{
+			const unsigned block = index * 64 + qCountTrailingZeroBits(word);
+			return block < bits ? block : -1;
+		}
+		if (++index >= (unsigned)words.size()) return -1;
+		word = ~words[index];
+	}
+}
+
+// ----------------------------------------------------------------------------
+int BlockMap::findLastSet() const
+{
+	for (int index = words.size() - 1; index >= 0; index--)
+	{
+		if (words[index])
+		{
+			return index * 64 + 63 - qCountLeadingZeroBits(words[index]);
+		}
+	}
+	return -1;
+}
+
+// ----------------------------------------------------------------------------
+bool BlockMap::intersects(const BlockMap &other) const
+{
+	const int count = qMin(words.size(), other.words.size());
+	for (int i = 0; i < count; i++)
+	{
+		if (words[i] & other.words[i]) return true;
+	}
+	return false;
+}
+
+// ----------------------------------------------------------------------------
+BlockMap& BlockMap::operator|=(const BlockMap &other)
+{
+	if (other.bits > bits)
+	{
+		resize(other.bits);
+	}
+
+	for (int i = 0; i < other.words.size(); i++)
+	{
+		words[i] |= other.words[i];
+	}
+	return *this;
+}
+
+// ----------------------------------------------------------------------------
+bool BlockMap::operator==(const BlockMap &other) const
+{
+	return bits == other.bits && words == other.words;
+}
+
+// ----------------------------------------------------------------------------
+void BlockMap::clearUnused()
+{
+	if (bits % 64)
+	{
+		words.last() &= (Q_UINT64_C(1) << (bits % 64)) - 1;
+	}
+}
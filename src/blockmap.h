@@ -0,0 +1,42 @@
+#pragma once
+
+#include <qglobal.h>
+#include <qvector.h>
+
+// Allocation bitmap with one bit per 128 KB block, for packs of any size.
+class BlockMap
+{
+public:
+	explicit BlockMap(unsigned size = 0);
+
+	// interprets a header's 32-bit block mask for a file whose header is in 'headerBlock'.
+	// in packs larger than 32 blocks, the mask covers the 32-block window containing the header
+	static BlockMap fromHeader(quint32 mask, unsigned headerBlock, unsigned totalBlocks);
+	// the opposite of fromHeader, for a file starting at 'firstBlock'
+	quint32 toHeader(unsigned firstBlock) const;
+
+	unsigned size() const;
+	void resize(unsigned size);
+
+	bool test(unsigned block) const;
+	void set(unsigned block, bool value = true);
+	void setRange(unsigned first, unsigned count, bool value = true);
+
+	unsigned count() const;
+	bool isEmpty() const;
+	// returns -1 if there's no such block
+	int findFirstSet(unsigned from = 0) const;
+	int findFirstClear(unsigned from = 0) const;
+	int findLastSet() const;
+
+	bool intersects(const BlockMap &other) const;
+	BlockMap& operator|=(const BlockMap &other);
+	bool operator==(const BlockMap &other) const;
+	bool operator!=(const BlockMap &other) const { return !(*this == other); }
+
+private:
+	void clearUnused();
+
+	QVector<quint64> words;
+	unsigned bits;
+};
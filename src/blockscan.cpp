@@ -0,0 +1,225 @@
+#include "blockscan.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#define BLOCKSCAN_X86
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		// MSVC allows using any intrinsics without special compiler flags
+		#define TARGET_SSE2
+		#define TARGET_AVX2
+	#else
+		#define TARGET_SSE2 __attribute__((target("sse2")))
+		#define TARGET_AVX2 __attribute__((target("avx2")))
+	#endif
+#endif
+
+// ----------------------------------------------------------------------------
+static quint16 byteSumScalar(const uchar *data, size_t size)
+{
+	quint16 sum = 0;
+	for (size_t i = 0; i < size; i++)
+	{
+		sum += data[i];
+	}
+	return sum;
+}
+
+// ----------------------------------------------------------------------------
+static bool isErasedScalar(const uchar *data, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		if (data[i] != 0xff) return false;
+	}
+	return true;
+}
+
+#ifdef BLOCKSCAN_X86
+// ----------------------------------------------------------------------------
+TARGET_SSE2 static quint16 byteSumSSE2(const uchar *data, size_t size)
+{
+	// psadbw against zero adds up 8 bytes at a time into 64-bit lanes,
+	// which can't realistically overflow
+	const __m128i zero = _mm_setzero_si128();
+	__m128i sum0 = zero, sum1 = zero;
+
+	size_t i = 0;
+	for (; i + 32 <= size; i += 32)
+	{
+		sum0 = _mm_add_epi64(sum0, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(data + i)), zero));
+		sum1 = _mm_add_epi64(sum1, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(data + i + 16)), zero));
+	}
+
+	quint64 lanes[2];
+	_mm_storeu_si128((__m128i*)lanes, _mm_add_epi64(sum0, sum1));
+
+	return quint16(lanes[0] + lanes[1]) + byteSumScalar(data + i, size - i);
+}
+
+// ----------------------------------------------------------------------------
+TARGET_SSE2 static bool isErasedSSE2(const uchar *data, size_t size)
+{
+	// AND together 64 bytes at a time and only compare once per chunk,
+	// so that non-erased blocks (usually non-0xff right away) still bail out early
+	const __m128i ones = _mm_set1_epi8(-1);
+
+	size_t i = 0;
+	for (; i + 64 <= size; i += 64)
+	{
+		__m128i bits = _mm_and_si128(
+			_mm_and_si128(_mm_loadu_si128((const __m128i*)(data + i)),      _mm_loadu_si128((const __m128i*)(data + i + 16))),
+			_mm_and_si128(_mm_loadu_si128((const __m128i*)(data + i + 32)), _mm_loadu_si128((const __m128i*)(data + i + 48))));
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(bits, ones)) != 0xffff) return false;
+	}
+
+	return isErasedScalar(data + i, size - i);
+}
+
+// ----------------------------------------------------------------------------
+TARGET_AVX2 static quint16 byteSumAVX2(const uchar *data, size_t size)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i sum0 = zero, sum1 = zero;
+
+	size_t i = 0;
+	for (; i + 64 <= size; i += 64)
+	{
+		sum0 = _mm256_add_epi64(sum0, _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)(data + i)), zero));
+		sum1 = _mm256_add_epi64(sum1, _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)(data + i + 32)), zero));
+	}
+
+	quint64 lanes[4];
+	_mm256_storeu_si256((__m256i*)lanes, _mm256_add_epi64(sum0, sum1));
+
+	return quint16(lanes[0] + lanes[1] + lanes[2] + lanes[3]) + byteSumSSE2(data + i, size - i);
+}
+
+// ----------------------------------------------------------------------------
+TARGET_AVX2 static bool isErasedAVX2(const uchar *data, size_t size)
+{
+	const __m256i ones = _mm256_set1_epi8(-1);
+
+	size_t i = 0;
+	for (; i + 128 <= size; i += 128)
+	{
+		__m256i bits = _mm256_and_si256(
+			_mm256_and_si256(_mm256_loadu_si256((const __m256i*)(data + i)),      _mm256_loadu_si256((const __m256i*)(data + i + 32))),
+			_mm256_and_si256(_mm256_loadu_si256((const __m256i*)(data + i + 64)), _mm256_loadu_si256((const __m256i*)(data + i + 96))));
+
+		// testc is set if every bit of 'ones' is also set in 'bits'
+		if (!_mm256_testc_si256(bits, ones)) return false;
+	}
+
+	return isErasedSSE2(data + i, size - i);
+}
+
+// ----------------------------------------------------------------------------
+static bool cpuHasSSE2()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+	return true; // always present on x86-64
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return info[3] & (1 << 26);
+#else
+	return __builtin_cpu_supports("sse2");
+#endif
+}
+
+// ----------------------------------------------------------------------------
+static bool cpuHasAVX2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+
+	// the OS also needs to save/restore the upper halves of the YMM registers
+	__cpuid(info, 1);
+	if (!(info[2] & (1 << 27)) || (_xgetbv(0) & 6) != 6) return false;
+
+	__cpuidex(info, 7, 0);
+	return info[1] & (1 << 5);
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif // BLOCKSCAN_X86
+
+// ----------------------------------------------------------------------------
+struct BlockScanKernels
+{
+	quint16 (*byteSum)(const uchar*, size_t);
+	bool (*isErased)(const uchar*, size_t);
+
+	BlockScanKernels()
+	{
+		byteSum = byteSumScalar;
+		isErased = isErasedScalar;
+
+#ifdef BLOCKSCAN_X86
+		if (cpuHasAVX2())
+		{
+			byteSum = byteSumAVX2;
+			isErased = isErasedAVX2;
+		}
+		else if (cpuHasSSE2())
+		{
+			byteSum = byteSumSSE2;
+			isErased = isErasedSSE2;
+		}
+#endif
+	}
+};
+
+// ----------------------------------------------------------------------------
+static const BlockScanKernels& kernels()
+{
+	static const BlockScanKernels kernels;
+	return kernels;
+}
+
+// ----------------------------------------------------------------------------
+quint16 byteSum(const void *data, size_t size)
+{
+	return kernels().byteSum((const uchar*)data, size);
+}
+
+// ----------------------------------------------------------------------------
+bool isErased(const void *data, size_t size)
+{
+	return kernels().isErased((const uchar*)data, size);
+}
+
+// ----------------------------------------------------------------------------
+bool blockScanSelfTest()
+{
+	// pseudo-random data, at odd sizes and alignments to cover the leftover bytes of each loop
+	uchar test[4099];
+	quint32 seed = 1;
+	for (size_t i = 0; i < sizeof test; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		test[i] = seed >> 16;
+	}
+	for (size_t size = 0; size < sizeof test; size += 97)
+	{
+		if (byteSum(test + 3, size) != byteSumScalar(test + 3, size)) return false;
+	}
+
+	// erased data with one byte changed at a time
+	memset(test, 0xff, sizeof test);
+	for (size_t pos = 0; pos < sizeof test; pos += 89)
+	{
+		if (!isErased(test + 1, sizeof test - 1)) return false;
+		test[pos] = 0xfe;
+		if (isErased(test + 1, sizeof test - 1) != isErasedScalar(test + 1, sizeof test - 1)) return false;
+		test[pos] = 0xff;
+	}
+
+	return true;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <qglobal.h>
+#include <cstddef>
+
+// Fast kernels for scanning through memory pack data, with SSE2/AVX2
+// versions selected at runtime depending on what the CPU supports.
+
+// sum of all bytes (modulo 2^16), as used by the BS-X header checksum
+quint16 byteSum(const void *data, size_t size);
+
+// true if every byte is 0xff, i.e. the data is erased flash
+bool isErased(const void *data, size_t size);
+
+// checks that the kernels selected for this CPU give exactly the same results as the plain ones
+bool blockScanSelfTest();
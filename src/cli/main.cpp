@@ -0,0 +1,585 @@
+#include "dumpthread.h"
+#include "blockindex.h"
+#include "blockscan.h"
+#include "mempackexport.h"
+#include "mempackloader.h"
+#include "packstore.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QSet>
+#include <QTextStream>
+#include <QtConcurrentMap>
+
+#include <cstdio>
+
+enum ExitCode
+{
+	ExitSuccess = 0,
+	ExitFailed  = 1,
+	ExitUsage   = 2,
+};
+
+// ----------------------------------------------------------------------------
+static QTextStream& endLine(QTextStream &stream)
+{
+	// same as endl, which is deprecated since Qt 5.15 (and Qt::endl doesn't exist before 5.14)
+	stream << '\n';
+	stream.flush();
+	return stream;
+}
+
+// ----------------------------------------------------------------------------
+static int dump(const QCommandLineParser &parser)
+{
+	QTextStream out(stdout);
+
+	USBDevice::DeviceType deviceType;
+	const QString deviceName = parser.value("device").toLower();
+	if (deviceName == "inlretro")
+	{
+		deviceType = USBDevice::INLRetro;
+	}
+	else
+	{
+		QTextStream(stderr) << QCoreApplication::translate("cli", "Unknown device: %1").arg(deviceName) << endLine;
+		return ExitUsage;
+	}
+
+	const QString outPath = parser.value("out");
+	if (outPath.isEmpty())
+	{
+		QTextStream(stderr) << QCoreApplication::translate("cli", "No output file specified (use --out).") << endLine;
+		return ExitUsage;
+	}
+
+	USBDumpThread dumpThread(deviceType, outPath);
+	bool ok = false;
+	int lastPercent = -1;
+
+	// queued to the main thread, the same way the GUI receives them
+	QObject::connect(&dumpThread, &USBDumpThread::showMessage, qApp, [&](const QString &msg)
+	{
+		out << msg << endLine;
+	});
+	QObject::connect(&dumpThread, &USBDumpThread::dumpProgress, qApp, [&](int val, int max)
+	{
+		// one line per percent, so that scripts can follow along without being flooded
+		const int percent = max > 0 ? (qint64)val * 100 / max : 0;
+		if (percent != lastPercent)
+		{
+			out << QString("progress %1%").arg(percent) << endLine;
+			lastPercent = percent;
+		}
+	});
+	QObject::connect(&dumpThread, &USBDumpThread::dumpSpeed, qApp, [&](double current, double average, int secondsLeft)
+	{
+		out << QString("speed %1 KB/s average %2 KB/s eta %3 s")
+			.arg(current / 1024, 0, 'f', 1)
+			.arg(average / 1024, 0, 'f', 1)
+			.arg(secondsLeft) << endLine;
+	});
+	QObject::connect(&dumpThread, &USBDumpThread::dumpFinished, qApp, [&]()
+	{
+		ok = true;
+	});
+	QObject::connect(&dumpThread, &QThread::finished, qApp, &QCoreApplication::quit);
+
+	dumpThread.start();
+	qApp->exec();
+	dumpThread.wait();
+
+	// the dump only counts if it actually made it to disk
+	return ok && dumpThread.saved() ? ExitSuccess : ExitFailed;
+}
+
+// ----------------------------------------------------------------------------
+template<typename Callback>
+static void forEachPack(const QStringList &paths, Callback callback)
+{
+	// one pack at a time (loading one already uses every core), and each one is dropped
+	// before the next is opened, so archives of any size never run out of files or memory
+	for (const QString &path : MemPackLoader::findFiles(paths))
+	{
+		MemPackLoadResult result = MemPackLoader::loadFile(path);
+		if (!result.errorString.isEmpty())
+		{
+			QTextStream(stderr) << QCoreApplication::translate("cli", "Couldn't open %1: %2")
+				.arg(result.path, result.errorString) << endLine;
+		}
+
+		callback(result);
+	}
+}
+
+// ----------------------------------------------------------------------------
+static int indexPacks(const QCommandLineParser &parser)
+{
+	QTextStream out(stdout);
+
+	const QString indexPath = parser.value("out");
+	const QStringList paths = parser.positionalArguments().mid(1);
+	if (indexPath.isEmpty() || paths.isEmpty())
+	{
+		QTextStream(stderr) << QCoreApplication::translate("cli", "Usage: index --out <index> <packs or folders...>") << endLine;
+		return ExitUsage;
+	}
+
+	// add to an existing index instead of starting over
+	BlockIndex index;
+	if (QFile::exists(indexPath) && !index.load(indexPath))
+	{
+		QTextStream(stderr) << index.errorString() << endLine;
+		return ExitFailed;
+	}
+
+	forEachPack(paths, [&](MemPackLoadResult &result)
+	{
+		const int added = index.addItems(result.items);
+		if (added)
+		{
+			out << QString("indexed %1 file(s) from %2").arg(added).arg(result.path) << endLine;
+		}
+	});
+
+	if (!index.save(indexPath))
+	{
+		QTextStream(stderr) << index.errorString() << endLine;
+		return ExitFailed;
+	}
+
+	out << QString("index has %1 file(s), %2 block(s)").arg(index.fileCount()).arg(index.blockCount()) << endLine;
+	return ExitSuccess;
+}
+
+// ----------------------------------------------------------------------------
+static int recoverFiles(const QCommandLineParser &parser)
+{
+	QTextStream out(stdout);
+
+	const QString indexPath = parser.value("index");
+	const QStringList paths = parser.positionalArguments().mid(1);
+	if (indexPath.isEmpty() || paths.isEmpty())
+	{
+		QTextStream(stderr) << QCoreApplication::translate("cli", "Usage: recover --index <index> [--out <folder>] <packs or folders...>") << endLine;
+		return ExitUsage;
+	}
+
+	BlockIndex index;
+	if (!index.load(indexPath))
+	{
+		QTextStream(stderr) << index.errorString() << endLine;
+		return ExitFailed;
+	}
+
+	const QString outPath = parser.value("out");
+	if (!outPath.isEmpty() && !QDir().mkpath(outPath))
+	{
+		QTextStream(stderr) << QCoreApplication::translate("cli", "Couldn't create %1.").arg(outPath) << endLine;
+		return ExitFailed;
+	}
+
+	int exitCode = ExitSuccess;
+	// file names are numbered across all packs, so recovering the same title twice doesn't overwrite anything
+	QSet<QString> usedNames;
+
+	forEachPack(paths, [&](MemPackLoadResult &result)
+	{
+		if (!result.errorString.isEmpty())
+		{
+			exitCode = ExitFailed;
+			return;
+		}
+
+		const MemPackItems recovered = MemPackLoader::recover(result.items, index);
+		for (const auto& job : MemPackExporter::plan(recovered, QDir(outPath), &usedNames))
+		{
+			out << QString("%1: recovered \"%2\" (%3)").arg(result.path, job.item.title)
+				.arg(job.item.integrity == MemPackItem::ChecksumBad ? "incomplete" : "complete");
+
+			if (!outPath.isEmpty())
+			{
+				out << QString(" as %1").arg(QDir::toNativeSeparators(job.path));
+
+				const QString error = MemPackExporter::exportItem(job);
+				if (!error.isEmpty())
+				{
+					QTextStream(stderr) << error << endLine;
+					exitCode = ExitFailed;
+				}
+			}
+			out << endLine;
+		}
+	});
+
+	return exitCode;
+}
+
+// ----------------------------------------------------------------------------
+static int store(const QCommandLineParser &parser)
+{
+	QTextStream out(stdout);
+	QTextStream err(stderr);
+
+	const QStringList args = parser.positionalArguments().mid(1);
+	const QString action = args.value(0);
+	const QString storePath = parser.value("store");
+	if (storePath.isEmpty() || action.isEmpty())
+	{
+		err << QCoreApplication::translate("cli", "Usage: store --store <folder> add <packs or folders...>\n"
+		                                          "       store --store <folder> get <name> --out <file>\n"
+		                                          "       store --store <folder> find <packs...>\n"
+		                                          "       store --store <folder> list") << endLine;
+		return ExitUsage;
+	}
+
+	PackStore packStore(storePath);
+
+	if (action == "add")
+	{
+		int exitCode = ExitSuccess;
+		for (const QString &path : MemPackLoader::findFiles(args.mid(1)))
+		{
+			const QString name = packStore.addPack(path);
+			if (!name.isEmpty())
+			{
+				out << QString("stored %1 as \"%2\"").arg(path, name) << endLine;
+			}
+			else
+			{
+				err << packStore.errorString() << endLine;
+				exitCode = ExitFailed;
+			}
+		}
+		return exitCode;
+	}
+	else if (action == "get")
+	{
+		const QString outPath = parser.value("out");
+		if (args.size() != 2 || outPath.isEmpty())
+		{
+			err << QCoreApplication::translate("cli", "Usage: store --store <folder> get <name> --out <file>") << endLine;
+			return ExitUsage;
+		}
+
+		const QByteArray image = packStore.rebuildPack(args[1]);
+		if (image.isNull())
+		{
+			err << packStore.errorString() << endLine;
+			return ExitFailed;
+		}
+
+		QSaveFile file(outPath);
+		if (!file.open(QIODevice::WriteOnly) || file.write(image) != image.size() || !file.commit())
+		{
+			err << QCoreApplication::translate("cli", "Couldn't write %1.").arg(outPath) << endLine;
+			return ExitFailed;
+		}
+		return ExitSuccess;
+	}
+	else if (action == "find")
+	{
+		// which stored packs contain each of the files in these packs
+		forEachPack(args.mid(1), [&](MemPackLoadResult &result)
+		{
+			for (const auto& item : result.items)
+			{
+				if (item.placeholder) continue;
+
+				const QStringList packs = packStore.packsContaining(PackStore::blobHash(item));
+				out << QString("%1: \"%2\": %3").arg(result.path, item.title)
+					.arg(packs.isEmpty() ? QString("(not stored)") : packs.join(", ")) << endLine;
+			}
+		});
+		return ExitSuccess;
+	}
+	else if (action == "list")
+	{
+		for (const QString &name : packStore.packs())
+		{
+			out << name << endLine;
+		}
+		return ExitSuccess;
+	}
+
+	err << QCoreApplication::translate("cli", "Unknown store action: %1").arg(action) << endLine;
+	return ExitUsage;
+}
+
+// ----------------------------------------------------------------------------
+struct ConvertJob
+{
+	QString packPath;
+	QString outPath;
+};
+
+// one line of the manifest
+struct ConvertedItem
+{
+	QString pack;
+	QString file;
+	QString title;
+	int month;
+	int day;
+	unsigned blocks;
+	bool deleted;
+	quint16 checksum;                 // as exported
+	MemPackItem::Integrity integrity; // of the checksum that was loaded
+};
+
+struct ConvertResult
+{
+	QVector<ConvertedItem> items;
+	QStringList errors;
+};
+
+// ----------------------------------------------------------------------------
+static ConvertResult convertPack(const ConvertJob &job)
+{
+	ConvertResult result;
+
+	const MemPackLoadResult pack = MemPackLoader::loadFile(job.packPath);
+	if (!pack.errorString.isEmpty())
+	{
+		result.errors.append(QString("%1: %2").arg(job.packPath, pack.errorString));
+		return result;
+	}
+
+	// only the files are exported, not the placeholders for any leftover data
+	if (pack.numFiles == 0) return result;
+
+	const QDir dir(job.outPath);
+	if (!dir.mkpath("."))
+	{
+		result.errors.append(QCoreApplication::translate("cli", "Couldn't create %1.").arg(job.outPath));
+		return result;
+	}
+
+	for (const auto& exportJob : MemPackExporter::plan(pack.items, dir))
+	{
+		const QString error = MemPackExporter::exportItem(exportJob);
+		if (!error.isEmpty())
+		{
+			result.errors.append(error);
+			continue;
+		}
+
+		// the checksum as written to the exported file, which is only the same as the one
+		// that was loaded if it was correct (the integrity says whether it was)
+		const MemPackItem &item = exportJob.item;
+		result.items.append({ job.packPath, exportJob.path, item.title,
+			item.header.month >> 4, item.header.day >> 3, item.blocks, item.deleted,
+			item.headerFor(0).checksum, item.integrity });
+	}
+
+	return result;
+}
+
+// ----------------------------------------------------------------------------
+static QString integrityName(MemPackItem::Integrity integrity)
+{
+	switch (integrity)
+	{
+	case MemPackItem::ChecksumOK:  return "ok";
+	case MemPackItem::ChecksumBad: return "bad";
+	case MemPackItem::NoChecksum:  return "none";
+	default:                       return "unchecked";
+	}
+}
+
+// ----------------------------------------------------------------------------
+static QString csvField(QString value)
+{
+	if (value.contains(',') || value.contains('"') || value.contains('\n'))
+	{
+		value = '"' + value.replace('"', "\"\"") + '"';
+	}
+	return value;
+}
+
+// ----------------------------------------------------------------------------
+static QByteArray convertManifest(const QVector<ConvertedItem> &items, const QDir &outDir, bool json)
+{
+	if (json)
+	{
+		QJsonArray array;
+		for (const auto& item : items)
+		{
+			QJsonObject entry;
+			entry["pack"] = item.pack;
+			entry["file"] = outDir.relativeFilePath(item.file);
+			entry["title"] = item.title;
+			entry["month"] = item.month;
+			entry["day"] = item.day;
+			entry["blocks"] = (int)item.blocks;
+			entry["deleted"] = item.deleted;
+			entry["checksum"] = QString("%1").arg(item.checksum, 4, 16, QChar('0'));
+			entry["integrity"] = integrityName(item.integrity);
+			array.append(entry);
+		}
+		return QJsonDocument(array).toJson();
+	}
+
+	QString csv = "pack,file,title,month,day,blocks,deleted,checksum,integrity\n";
+	for (const auto& item : items)
+	{
+		csv += QStringList({
+			csvField(item.pack),
+			csvField(outDir.relativeFilePath(item.file)),
+			csvField(item.title),
+			QString::number(item.month),
+			QString::number(item.day),
+			QString::number(item.blocks),
+			item.deleted ? "yes" : "no",
+			QString("%1").arg(item.checksum, 4, 16, QChar('0')),
+			integrityName(item.integrity)
+		}).join(',') + '\n';
+	}
+	return csv.toUtf8();
+}
+
+// ----------------------------------------------------------------------------
+static int convert(const QCommandLineParser &parser)
+{
+	QTextStream out(stdout);
+	QTextStream err(stderr);
+
+	const QString outPath = parser.value("out");
+	const QStringList paths = parser.positionalArguments().mid(1);
+	if (outPath.isEmpty() || paths.isEmpty())
+	{
+		err << QCoreApplication::translate("cli", "Usage: convert --out <folder> [--manifest <file.csv|file.json>] <packs or folders...>") << endLine;
+		return ExitUsage;
+	}
+
+	// each pack gets its own folder, numbered the same way as exported files if two packs have the same name
+	const QDir outDir(outPath);
+	QVector<ConvertJob> jobs;
+	QSet<QString> usedNames;
+
+	for (const QString &path : MemPackLoader::findFiles(paths))
+	{
+		const QString baseName = QFileInfo(path).completeBaseName();
+		QString name = baseName;
+		for (int num = 2; usedNames.contains(name.toLower()); num++)
+		{
+			name = QString("%1 (%2)").arg(baseName).arg(num);
+		}
+		usedNames.insert(name.toLower());
+
+		jobs.append({ path, outDir.filePath(name) });
+	}
+
+	// one pack per thread at a time, so only the packs currently being converted are kept in memory
+	const QVector<ConvertResult> results = QtConcurrent::blockingMapped<QVector<ConvertResult>>(jobs, convertPack);
+
+	int exitCode = ExitSuccess;
+	QVector<ConvertedItem> converted;
+
+	for (int i = 0; i < results.size(); i++)
+	{
+		for (const QString &error : results[i].errors)
+		{
+			err << error << endLine;
+			exitCode = ExitFailed;
+		}
+		if (!results[i].items.isEmpty())
+		{
+			out << QString("converted %1 file(s) from %2").arg(results[i].items.size()).arg(jobs[i].packPath) << endLine;
+		}
+		converted += results[i].items;
+	}
+
+	const QString manifestPath = parser.value("manifest");
+	if (!manifestPath.isEmpty())
+	{
+		const bool json = QFileInfo(manifestPath).suffix().compare("json", Qt::CaseInsensitive) == 0;
+		const QByteArray manifest = convertManifest(converted, outDir, json);
+
+		QSaveFile file(manifestPath);
+		if (!file.open(QIODevice::WriteOnly) || file.write(manifest) != manifest.size() || !file.commit())
+		{
+			err << QCoreApplication::translate("cli", "Couldn't write %1.").arg(manifestPath) << endLine;
+			return ExitFailed;
+		}
+	}
+
+	out << QString("converted %1 file(s) from %2 pack(s)").arg(converted.size()).arg(jobs.size()) << endLine;
+	return exitCode;
+}
+
+// ----------------------------------------------------------------------------
+static int selfTest()
+{
+	if (!blockScanSelfTest())
+	{
+		QTextStream(stderr) << QCoreApplication::translate("cli", "The block scanning code gives wrong results on this CPU.") << endLine;
+		return ExitFailed;
+	}
+
+	QTextStream(stdout) << "self test passed" << endLine;
+	return ExitSuccess;
+}
+
+// ----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+	QCoreApplication a(argc, argv);
+	a.setApplicationName("bsflash-cli");
+	a.setApplicationVersion("0.2.0");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription(QCoreApplication::translate("cli", "BS-X Flash Manager command line tool"));
+	parser.addHelpOption();
+	parser.addVersionOption();
+	parser.addPositionalArgument("command", QCoreApplication::translate("cli", "Command to run (dump, index, recover, store, convert, selftest)."));
+
+	parser.addOption(QCommandLineOption("device",
+		QCoreApplication::translate("cli", "USB device to dump from (default: inlretro)."), "name", "inlretro"));
+	parser.addOption(QCommandLineOption(QStringList() << "o" << "out",
+		QCoreApplication::translate("cli", "Output file or folder."), "path"));
+	parser.addOption(QCommandLineOption("index",
+		QCoreApplication::translate("cli", "Block index to recover files with."), "path"));
+	parser.addOption(QCommandLineOption("store",
+		QCoreApplication::translate("cli", "Folder containing a deduplicated pack store."), "path"));
+	parser.addOption(QCommandLineOption("manifest",
+		QCoreApplication::translate("cli", "CSV or JSON file to list converted files in."), "path"));
+
+	parser.process(a);
+
+	const QStringList args = parser.positionalArguments();
+	const QString command = args.isEmpty() ? QString() : args.first();
+
+	if (command == "dump")
+	{
+		return dump(parser);
+	}
+	else if (command == "index")
+	{
+		return indexPacks(parser);
+	}
+	else if (command == "recover")
+	{
+		return recoverFiles(parser);
+	}
+	else if (command == "store")
+	{
+		return store(parser);
+	}
+	else if (command == "convert")
+	{
+		return convert(parser);
+	}
+	else if (command == "selftest")
+	{
+		return selfTest();
+	}
+
+	QTextStream(stderr) << parser.helpText();
+	return ExitUsage;
+}
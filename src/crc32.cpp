@@ -0,0 +1,64 @@
+#include "crc32.h"
+
+// ----------------------------------------------------------------------------
+static const struct CRCTable
+{
+	quint32 entries[256];
+
+	CRCTable()
+	{
+		for (quint32 i = 0; i < 256; i++)
+		{
+			quint32 crc = i;
+			for (int j = 0; j < 8; j++)
+			{
+				crc = (crc >> 1) ^ (crc & 1 ? 0xedb88320 : 0);
+			}
+			entries[i] = crc;
+		}
+	}
+} crcTable;
+
+// ----------------------------------------------------------------------------
+CRC32::CRC32()
+{
+	reset();
+}
+
+// ----------------------------------------------------------------------------
+void CRC32::reset()
+{
+	crc = 0xffffffff;
+}
+
+// ----------------------------------------------------------------------------
+void CRC32::addData(const char *data, int length)
+{
+	const quint32 *table = crcTable.entries;
+	const uchar *bytes = (const uchar*)data;
+
+	for (int i = 0; i < length; i++)
+	{
+		crc = table[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+	}
+}
+
+// ----------------------------------------------------------------------------
+void CRC32::addData(const QByteArray &data)
+{
+	addData(data.constData(), data.size());
+}
+
+// ----------------------------------------------------------------------------
+quint32 CRC32::result() const
+{
+	return ~crc;
+}
+
+// ----------------------------------------------------------------------------
+quint32 CRC32::hash(const QByteArray &data)
+{
+	CRC32 crc;
+	crc.addData(data);
+	return crc.result();
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <qbytearray.h>
+
+// Incremental CRC-32 (the same polynomial used by zip, sfv, no-intro, etc.)
+class CRC32
+{
+public:
+	CRC32();
+
+	void reset();
+	void addData(const char *data, int length);
+	void addData(const QByteArray &data);
+	quint32 result() const;
+
+	static quint32 hash(const QByteArray &data);
+
+private:
+	quint32 crc;
+};
@@ -0,0 +1,91 @@
+#include "dumphasher.h"
+
+#include <qfile.h>
+#include <qfileinfo.h>
+#include <qjsonarray.h>
+#include <qjsondocument.h>
+#include <qjsonobject.h>
+
+// ----------------------------------------------------------------------------
+DumpHasher::DumpHasher()
+	: fileHash(QCryptographicHash::Sha1)
+	, blockHash(QCryptographicHash::Sha1)
+	, blockFill(0)
+	, totalSize(0)
+{
+
+}
+
+// ----------------------------------------------------------------------------
+void DumpHasher::addData(const QByteArray &data)
+{
+	fileCRC.addData(data);
+	fileHash.addData(data);
+	totalSize += data.size();
+
+	// split incoming data along 128 KB block boundaries
+	int pos = 0;
+	while (pos < data.size())
+	{
+		const int size = qMin((unsigned)(data.size() - pos), (1u << 17) - blockFill);
+		blockHash.addData(data.constData() + pos, size);
+
+		pos += size;
+		blockFill += size;
+		if (blockFill == (1 << 17))
+		{
+			blockHashResults.append(blockHash.result());
+			blockHash.reset();
+			blockFill = 0;
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+void DumpHasher::finish()
+{
+	// flush a final partial block, if any
+	if (blockFill)
+	{
+		blockHashResults.append(blockHash.result());
+		blockHash.reset();
+		blockFill = 0;
+	}
+	fileHashResult = fileHash.result();
+}
+
+// ----------------------------------------------------------------------------
+quint32 DumpHasher::crc32() const
+{
+	return fileCRC.result();
+}
+
+// ----------------------------------------------------------------------------
+QByteArray DumpHasher::sha1() const
+{
+	return fileHashResult;
+}
+
+// ----------------------------------------------------------------------------
+bool DumpHasher::writeSidecar(const QString &dumpPath) const
+{
+	// e.g. "pack.bs" -> "pack.bs.hashes.json"
+	QFile file(dumpPath + ".hashes.json");
+	if (!file.open(QFile::WriteOnly | QFile::Truncate)) return false;
+
+	QJsonArray blocks;
+	for (const auto& hash : blockHashResults)
+	{
+		blocks.append(QString(hash.toHex()));
+	}
+
+	QJsonObject hashes;
+	hashes["file"] = QFileInfo(dumpPath).fileName();
+	hashes["size"] = (double)totalSize;
+	hashes["crc32"] = QString("%1").arg(crc32(), 8, 16, QChar('0'));
+	hashes["sha1"] = QString(fileHashResult.toHex());
+	hashes["blockSha1"] = blocks;
+
+	const QByteArray json = QJsonDocument(hashes).toJson();
+	return file.write(json) == json.size();
+}
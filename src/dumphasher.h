@@ -0,0 +1,30 @@
+#pragma once
+
+#include <qcryptographichash.h>
+#include "crc32.h"
+#include "dumpqueue.h"
+
+// Hashes dumped data as it comes in.
+// Computes a CRC32 and SHA-1 of the whole dump, plus a SHA-1 of each 128 KB block.
+class DumpHasher : public DumpSink
+{
+public:
+	DumpHasher();
+
+	void addData(const QByteArray&);
+	void finish();
+
+	quint32 crc32() const;
+	QByteArray sha1() const;
+
+	bool writeSidecar(const QString &dumpPath) const;
+
+private:
+	CRC32 fileCRC;
+	QCryptographicHash fileHash;
+	QCryptographicHash blockHash;
+	unsigned blockFill;
+	quint64 totalSize;
+	QByteArray fileHashResult;
+	QList<QByteArray> blockHashResults;
+};
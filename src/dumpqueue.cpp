@@ -0,0 +1,71 @@
+#include "dumpqueue.h"
+
+// ----------------------------------------------------------------------------
+DumpQueue::DumpQueue(QObject *parent)
+	: QThread(parent)
+	, finished(false)
+{
+
+}
+
+// ----------------------------------------------------------------------------
+DumpQueue::~DumpQueue()
+{
+	finish();
+}
+
+// ----------------------------------------------------------------------------
+void DumpQueue::addSink(DumpSink *sink)
+{
+	sinks.append(sink);
+}
+
+// ----------------------------------------------------------------------------
+void DumpQueue::addData(const QByteArray &data)
+{
+	// QByteArray is implicitly shared, so this doesn't copy the data
+	QMutexLocker lock(&mutex);
+	queue.enqueue(data);
+	dataReady.wakeOne();
+}
+
+// ----------------------------------------------------------------------------
+void DumpQueue::finish()
+{
+	{
+		QMutexLocker lock(&mutex);
+		finished = true;
+		dataReady.wakeOne();
+	}
+
+	wait();
+}
+
+// ----------------------------------------------------------------------------
+void DumpQueue::run()
+{
+	while (true)
+	{
+		QByteArray data;
+		{
+			QMutexLocker lock(&mutex);
+			while (queue.isEmpty() && !finished)
+			{
+				dataReady.wait(&mutex);
+			}
+
+			if (queue.isEmpty()) break;
+			data = queue.dequeue();
+		}
+
+		for (DumpSink *sink : sinks)
+		{
+			sink->addData(data);
+		}
+	}
+
+	for (DumpSink *sink : sinks)
+	{
+		sink->finish();
+	}
+}
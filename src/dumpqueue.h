@@ -0,0 +1,43 @@
+#pragma once
+
+#include <qthread.h>
+#include <qmutex.h>
+#include <qwaitcondition.h>
+#include <qqueue.h>
+
+// Something that does work with dumped data as it comes in (see DumpQueue).
+class DumpSink
+{
+public:
+	virtual ~DumpSink() {}
+
+	virtual void addData(const QByteArray&) = 0;
+	// called once all data has been added
+	virtual void finish() {}
+};
+
+// Hands dumped data to each sink on a separate thread, so the USB read loop never waits on them.
+class DumpQueue : public QThread
+{
+public:
+	DumpQueue(QObject *parent = Q_NULLPTR);
+	~DumpQueue();
+
+	// sinks have to be added before starting the thread
+	void addSink(DumpSink*);
+
+	void addData(const QByteArray&);
+	// waits until every sink has been given all of the data and finished
+	void finish();
+
+protected:
+	void run();
+
+private:
+	QList<DumpSink*> sinks;
+
+	QMutex mutex;
+	QWaitCondition dataReady;
+	QQueue<QByteArray> queue;
+	bool finished;
+};
@@ -0,0 +1,310 @@
+#include "dumpthread.h"
+#include "dumphasher.h"
+#include "dumpqueue.h"
+#include "dumpwriter.h"
+#include "usb/inlretro.h"
+
+#include <qsavefile.h>
+#include <qfileinfo.h>
+#include <qelapsedtimer.h>
+#include <qdatetime.h>
+#include <qjsonarray.h>
+#include <qjsondocument.h>
+#include <qjsonobject.h>
+#include <qdebug.h>
+
+#include <algorithm>
+
+// uncomment to try to detect valid flash memory
+//#define DETECT_MEMORY_PACK
+
+// ----------------------------------------------------------------------------
+USBDumpThread::USBDumpThread(USBDevice::DeviceType deviceType, const QString &outPath, QObject *parent)
+	: QThread(parent)
+	, outPath(outPath)
+	, dumpSaved(false)
+	, bankOffset(0)
+	, totalSize(0)
+{
+	switch (deviceType)
+	{
+	case USBDevice::INLRetro:
+		this->usbDevice = new INLRetroDevice(this);
+		break;
+
+	default:
+		this->usbDevice = nullptr;
+	}
+
+	if (this->usbDevice)
+	{
+		connect(this->usbDevice, SIGNAL(usbLogMessage(QString)), this, SIGNAL(showMessage(QString)));
+		// runs on the dump thread itself, so that the current bank offset is known
+		connect(this->usbDevice, SIGNAL(readProgress(uint, uint)), this, SLOT(bankProgress(uint, uint)),
+			Qt::DirectConnection);
+	}
+}
+
+// ----------------------------------------------------------------------------
+void USBDumpThread::run()
+{
+	DumpWriter writer(outPath);
+
+	bool ok = true;
+	dumpImage.clear();
+	dumpSaved = false;
+	cancelToken.reset();
+
+	// saving to disk is optional, the image itself is always kept in memory
+	if (!outPath.isEmpty() && !writer.open())
+	{
+		emit showMessage(tr("Couldn't open %1 for writing: %2").arg(outPath, writer.errorString()));
+		return;
+	}
+
+	if (this->usbDevice->open())
+	{
+		emit showMessage(tr("USB device opened successfully."));
+
+#ifdef DETECT_MEMORY_PACK
+		// first try to detect memory pack
+
+		// memory pack write enable
+		this->usbDevice->writeByte(0x0c, 0x5000, 0x80);
+		this->usbDevice->writeByte(0x0e, 0x5000, 0x00);
+
+		// restore default page buffer settings
+		this->usbDevice->writeByte(0xc0, 0x0000, 0x38);
+		this->usbDevice->writeByte(0xc0, 0x0000, 0xd0);
+
+		// swap in the vendor info page in the flash chip and see what we find
+		this->usbDevice->writeByte(0xc0, 0x0000, 0x72);
+		this->usbDevice->writeByte(0xc0, 0x0000, 0x75);
+		QByteArray flashInfo = this->usbDevice->readBytes(0xc0, 0xff00, 16);
+		this->usbDevice->writeByte(0xc0, 0x0000, 0xff);
+
+		// memory pack write disable
+		this->usbDevice->writeByte(0x0c, 0x5000, 0x00);
+		this->usbDevice->writeByte(0x0e, 0x5000, 0x00);
+
+		if (flashInfo.size() < 16
+			|| flashInfo[0] != 'M'
+			|| flashInfo[2] != 'P'
+			|| flashInfo[4] & 0x80)
+		{
+			emit showMessage(tr("No valid memory pack detected."));
+			ok = false;
+		}
+
+		quint8 flashType = (uchar)flashInfo[6] >> 4;
+		quint8 flashSize = 2 << (((uchar)flashInfo[6] & 0x0f) - 8);
+
+		if (ok) {
+			if (flashSize > 32)
+			{
+				qDebug() << "warning: bogus flash size" << flashSize << "blocks";
+				flashSize = 8;
+			}
+			emit showMessage(tr("Type %1 memory pack detected, %2 blocks.").arg(flashType).arg(flashSize));
+		}
+#else
+		quint8 flashSize = 8;
+#endif
+
+		QList<BankTiming> timings;
+		totalSize = flashSize << 17;
+		unsigned totalBytes = 0;
+
+		QElapsedTimer totalTimer, bankTimer;
+		totalTimer.start();
+
+		dumpImage.reserve(totalSize);
+
+		// hashing and saving happen on their own thread, as the data comes in
+		DumpHasher hasher;
+		DumpQueue queue;
+		queue.addSink(&hasher);
+		if (!outPath.isEmpty()) queue.addSink(&writer);
+		queue.start();
+
+		for (unsigned i = 0; ok && i < flashSize << 1; i++)
+		{
+			if (!(i & 1))
+			{
+				emit showMessage(tr("Dumping block %1 of %2...").arg((i >> 1) + 1).arg(flashSize));
+			}
+
+			bankOffset = i << 16;
+			emit dumpProgress(bankOffset, totalSize);
+
+			bankTimer.start();
+			const QByteArray bankData = this->usbDevice->readBytes(0xc0 + i, 0x0000, 1 << 16, &ok, &cancelToken);
+			const qint64 bankNsecs = bankTimer.nsecsElapsed();
+			dumpImage += bankData;
+			queue.addData(bankData);
+
+			BankTiming timing = { quint8(0xc0 + i), (unsigned)bankData.size(), bankNsecs };
+			timings.append(timing);
+			totalBytes += bankData.size();
+
+			// instantaneous speed is measured over the last bank only
+			const qint64 totalNsecs = totalTimer.nsecsElapsed();
+			const double current = bankNsecs > 0 ? bankData.size() * 1e9 / bankNsecs : 0.0;
+			const double average = totalNsecs > 0 ? totalBytes * 1e9 / totalNsecs : 0.0;
+			const int secondsLeft = average > 0 ? qRound((totalSize - qMin(totalBytes, totalSize)) / average) : 0;
+			emit dumpSpeed(current, average, secondsLeft);
+
+			yieldCurrentThread();
+			if (this->isInterruptionRequested())
+			{
+				ok = false;
+			}
+		}
+
+		const qint64 totalNsecs = totalTimer.nsecsElapsed();
+		reportTimings(timings, totalNsecs);
+
+		queue.finish();
+
+		// an incomplete dump never replaces an existing file
+		if (!outPath.isEmpty())
+		{
+			dumpSaved = writer.commit(ok && !this->isInterruptionRequested());
+		}
+
+		if (this->isInterruptionRequested())
+		{
+			emit showMessage(tr("Dump cancelled."));
+		}
+		else if (ok)
+		{
+			emit showMessage(tr("Full file dumped successfully."));
+			emit showMessage(tr("CRC32: %1").arg(hasher.crc32(), 8, 16, QChar('0')));
+			emit showMessage(tr("SHA-1: %1").arg(QString(hasher.sha1().toHex())));
+
+			// the other files describing the dump are only written once the dump itself has been
+			if (!outPath.isEmpty() && !dumpSaved)
+			{
+				emit showMessage(tr("Unable to save %1: %2").arg(outPath, writer.errorString()));
+			}
+			else if (!outPath.isEmpty())
+			{
+				if (!hasher.writeSidecar(outPath))
+				{
+					emit showMessage(tr("Unable to write dump hashes."));
+				}
+				if (!writeSummary(timings, totalNsecs))
+				{
+					emit showMessage(tr("Unable to write dump summary."));
+				}
+			}
+		}
+		else
+		{
+			emit showMessage(tr("File dump failed."));
+		}
+
+		if (ok)
+		{
+			emit dumpFinished();
+		}
+	}
+	else
+	{
+		emit showMessage(tr("USB device open failed."));
+		ok = false;
+	}
+
+	this->usbDevice->close();
+
+}
+
+// ----------------------------------------------------------------------------
+void USBDumpThread::cancel()
+{
+	requestInterruption();
+	cancelToken.cancel();
+}
+
+// ----------------------------------------------------------------------------
+void USBDumpThread::bankProgress(unsigned bytesRead, unsigned)
+{
+	emit dumpProgress(bankOffset + bytesRead, totalSize);
+}
+
+// ----------------------------------------------------------------------------
+const QByteArray& USBDumpThread::image() const
+{
+	return dumpImage;
+}
+
+// ----------------------------------------------------------------------------
+bool USBDumpThread::saved() const
+{
+	return dumpSaved;
+}
+
+// ----------------------------------------------------------------------------
+void USBDumpThread::reportTimings(const QList<BankTiming> &timings, qint64 totalNsecs)
+{
+	if (timings.isEmpty() || totalNsecs <= 0) return;
+
+	unsigned totalBytes = 0;
+	for (const auto& timing : timings)
+	{
+		totalBytes += timing.bytes;
+	}
+
+	emit showMessage(tr("Read %1 bytes in %2 s (average %3 KB/s).")
+		.arg(totalBytes)
+		.arg(totalNsecs / 1e9, 0, 'f', 2)
+		.arg(totalBytes * 1e9 / totalNsecs / 1024, 0, 'f', 1));
+
+	QList<BankTiming> slowest = timings;
+	std::sort(slowest.begin(), slowest.end(), [](const BankTiming &a, const BankTiming &b)
+	{
+		return a.nsecs > b.nsecs;
+	});
+
+	QStringList banks;
+	for (int i = 0; i < slowest.size() && i < 3; i++)
+	{
+		banks += tr("$%1 (%2 ms)")
+			.arg(slowest[i].bank, 2, 16, QChar('0'))
+			.arg(slowest[i].nsecs / 1000000);
+	}
+	emit showMessage(tr("Slowest banks: %1").arg(banks.join(", ")));
+}
+
+// ----------------------------------------------------------------------------
+bool USBDumpThread::writeSummary(const QList<BankTiming> &timings, qint64 totalNsecs)
+{
+	// written next to the dump itself, e.g. "pack.bs" -> "pack.bs.json"
+	QSaveFile file(outPath + ".json");
+	if (!file.open(QIODevice::WriteOnly)) return false;
+
+	unsigned totalBytes = 0;
+	QJsonArray banks;
+	for (const auto& timing : timings)
+	{
+		QJsonObject bank;
+		bank["bank"] = timing.bank;
+		bank["bytes"] = (int)timing.bytes;
+		bank["nsecs"] = (double)timing.nsecs;
+		bank["bytesPerSec"] = timing.nsecs > 0 ? timing.bytes * 1e9 / timing.nsecs : 0.0;
+		banks.append(bank);
+
+		totalBytes += timing.bytes;
+	}
+
+	QJsonObject summary;
+	summary["file"] = QFileInfo(outPath).fileName();
+	summary["date"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+	summary["bytes"] = (int)totalBytes;
+	summary["nsecs"] = (double)totalNsecs;
+	summary["bytesPerSec"] = totalNsecs > 0 ? totalBytes * 1e9 / totalNsecs : 0.0;
+	summary["banks"] = banks;
+
+	const QByteArray json = QJsonDocument(summary).toJson();
+	return file.write(json) == json.size() && file.commit();
+}
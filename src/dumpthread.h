@@ -0,0 +1,50 @@
+#pragma once
+
+#include <qthread.h>
+#include "usb/device.h"
+
+class USBDumpThread : public QThread
+{
+	Q_OBJECT
+
+public:
+	USBDumpThread(USBDevice::DeviceType deviceType, const QString &outPath, QObject *parent = Q_NULLPTR);
+
+	const QByteArray& image() const;
+	// whether the image was also written to the output path
+	bool saved() const;
+
+	void cancel();
+
+signals:
+	void showMessage(const QString&);
+
+	void dumpProgress(int val, int max);
+	void dumpSpeed(double current, double average, int secondsLeft);
+	void dumpFinished();
+
+protected:
+	void run();
+
+private slots:
+	void bankProgress(unsigned bytesRead, unsigned size);
+
+private:
+	struct BankTiming
+	{
+		quint8 bank;
+		unsigned bytes;
+		qint64 nsecs;
+	};
+
+	void reportTimings(const QList<BankTiming>&, qint64 totalNsecs);
+	bool writeSummary(const QList<BankTiming>&, qint64 totalNsecs);
+
+	QString outPath;
+	QByteArray dumpImage;
+	bool dumpSaved;
+	USBDevice *usbDevice;
+	USBDevice::CancelToken cancelToken;
+
+	unsigned bankOffset, totalSize;
+};
@@ -0,0 +1,57 @@
+#include "dumpwriter.h"
+
+// ----------------------------------------------------------------------------
+DumpWriter::DumpWriter(const QString &path)
+	: file(path)
+	, ok(true)
+{
+
+}
+
+// ----------------------------------------------------------------------------
+bool DumpWriter::open()
+{
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		error = file.errorString();
+		return false;
+	}
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+void DumpWriter::addData(const QByteArray &data)
+{
+	// once a write fails, the rest is just dropped
+	if (ok && file.write(data) != data.size())
+	{
+		ok = false;
+		error = file.errorString();
+	}
+}
+
+// ----------------------------------------------------------------------------
+bool DumpWriter::commit(bool keep)
+{
+	if (!file.isOpen()) return false;
+
+	if (keep && ok)
+	{
+		// also flushes and closes the file, so a full disk shows up here at the latest
+		ok = file.commit();
+		if (!ok) error = file.errorString();
+	}
+	else
+	{
+		file.cancelWriting();
+		file.commit();
+	}
+
+	return ok && keep;
+}
+
+// ----------------------------------------------------------------------------
+QString DumpWriter::errorString() const
+{
+	return error;
+}
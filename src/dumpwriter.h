@@ -0,0 +1,24 @@
+#pragma once
+
+#include <qsavefile.h>
+#include "dumpqueue.h"
+
+// Saves dumped data as it comes in. The file only replaces an existing one
+// once the whole dump has been written (see commit()).
+class DumpWriter : public DumpSink
+{
+public:
+	explicit DumpWriter(const QString &path);
+
+	bool open();
+	void addData(const QByteArray&);
+	// either keeps or discards the file, once the queue feeding it has finished
+	bool commit(bool keep);
+
+	QString errorString() const;
+
+private:
+	QSaveFile file;
+	bool ok;
+	QString error;
+};
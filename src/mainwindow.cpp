@@ -1,14 +1,39 @@
 #include "mainwindow.h"
 #include "mempackmodel.h"
+#include "blockindex.h"
+#include "mempackexport.h"
+#include "packcontainer.h"
+#include "packimage.h"
 #include "usbdump.h"
 
 #include "usb/inlretro.h"
 
-#include <qtemporaryfile.h>
+#include <qtconcurrentmap.h>
+#include <qtconcurrentrun.h>
+#include <qsavefile.h>
+#include <qbuffer.h>
 #include <qfiledialog.h>
 #include <qmessagebox.h>
+#include <qprogressdialog.h>
+#include <qmimedata.h>
 #include <qdebug.h>
 #include <QCloseEvent>
+#include <QDropEvent>
+
+// ----------------------------------------------------------------------------
+static const QByteArray& erasedBlock()
+{
+	static const QByteArray block(1 << 17, (char)0xff);
+	return block;
+}
+
+// ----------------------------------------------------------------------------
+template<typename T>
+static void releaseResults(QFutureWatcher<T> *watcher)
+{
+	// switch to a future that never started, since a default (finished) one would signal finished() again
+	watcher->setFuture(QFutureInterface<T>().future());
+}
 
 // ----------------------------------------------------------------------------
 MainWindow::MainWindow(QWidget *parent)
@@ -26,6 +51,14 @@ MainWindow::MainWindow(QWidget *parent)
 	memPackModel = new MemPackModel(this);
 	ui.listView->setModel(memPackModel);
 
+	loadWatcher = new QFutureWatcher<MemPackLoadResult>(this);
+	exportWatcher = new QFutureWatcher<QString>(this);
+	progress = nullptr;
+	connect(loadWatcher, SIGNAL(finished()), this, SLOT(addFilesFinished()));
+	connect(exportWatcher, SIGNAL(finished()), this, SLOT(exportAllFinished()));
+
+	setAcceptDrops(true);
+
 	ui.comboProgramType->addItem(tr("Normal program"),        0 << 8);
 	ui.comboProgramType->addItem(tr("BS-X bytecode program"), 1 << 8);
 	ui.comboProgramType->addItem(tr("SA-1 program"),          2 << 8);
@@ -39,6 +72,15 @@ MainWindow::MainWindow(QWidget *parent)
 	}
 
 	connect(memPackModel, SIGNAL(modelReset()), this, SLOT(updateSelected()));
+	connect(memPackModel, SIGNAL(layoutChanged()), this, SLOT(updateSelected()));
+
+	// keep the planned layout up to date with every change
+	connect(memPackModel, SIGNAL(modelReset()), this, SLOT(updateBlockCount()));
+	connect(memPackModel, SIGNAL(layoutChanged()), this, SLOT(updateBlockCount()));
+	connect(memPackModel, SIGNAL(rowsInserted(QModelIndex, int, int)), this, SLOT(updateBlockCount()));
+	connect(memPackModel, SIGNAL(rowsRemoved(QModelIndex, int, int)), this, SLOT(updateBlockCount()));
+	connect(memPackModel, SIGNAL(rowsMoved(QModelIndex, int, int, QModelIndex, int)), this, SLOT(updateBlockCount()));
+	connect(memPackModel, SIGNAL(dataChanged(QModelIndex, QModelIndex)), this, SLOT(updateBlockCount()));
 	connect(ui.listView->selectionModel(), SIGNAL(currentChanged(QModelIndex, QModelIndex)), 
 		this, SLOT(updateSelected()));
 
@@ -54,8 +96,12 @@ MainWindow::MainWindow(QWidget *parent)
 	connect(ui.actionOpen, SIGNAL(triggered(bool)), this, SLOT(openFile()));
 	connect(ui.actionSave, SIGNAL(triggered(bool)), this, SLOT(saveFile()));
 	connect(ui.actionSaveAs, SIGNAL(triggered(bool)), this, SLOT(saveFileAs()));
+	connect(ui.actionOptimizePlacement, SIGNAL(toggled(bool)), this, SLOT(updateBlockCount()));
+	connect(ui.actionOptimizePlacement, SIGNAL(toggled(bool)), this, SLOT(updateSelected()));
 	connect(ui.actionExport, SIGNAL(triggered(bool)), this, SLOT(exportSelected()));
 	connect(ui.actionExportAll, SIGNAL(triggered(bool)), this, SLOT(exportAll()));
+	connect(ui.actionExportArchive, SIGNAL(triggered(bool)), this, SLOT(exportArchive()));
+	connect(ui.actionRecover, SIGNAL(triggered(bool)), this, SLOT(recoverFiles()));
 	connect(ui.actionExit, SIGNAL(triggered(bool)), this, SLOT(close()));
 
 	connect(ui.actionTransferTest, SIGNAL(triggered(bool)), this, SLOT(transferTest()));
@@ -78,6 +124,34 @@ void MainWindow::closeEvent(QCloseEvent *event)
 	}
 }
 
+// ----------------------------------------------------------------------------
+void MainWindow::dragEnterEvent(QDragEnterEvent *event)
+{
+	if (event->mimeData()->hasUrls())
+	{
+		event->acceptProposedAction();
+	}
+}
+
+// ----------------------------------------------------------------------------
+void MainWindow::dropEvent(QDropEvent *event)
+{
+	QStringList paths;
+	for (const QUrl &url : event->mimeData()->urls())
+	{
+		if (url.isLocalFile())
+		{
+			paths.append(url.toLocalFile());
+		}
+	}
+
+	if (!paths.isEmpty())
+	{
+		event->acceptProposedAction();
+		addFiles(MemPackLoader::findFiles(paths));
+	}
+}
+
 // ----------------------------------------------------------------------------
 void MainWindow::about()
 {
@@ -104,7 +178,7 @@ void MainWindow::openFile()
 	if (!promptSave()) return;
 
 	QString fileName = QFileDialog::getOpenFileName(this, tr("Open File"),
-		lastFileName, tr("(*.sfc *.bs)"));
+		lastFileName, tr("(*.sfc *.bs *.bsz)"));
 
 	if (!fileName.isEmpty())
 	{
@@ -117,8 +191,13 @@ bool MainWindow::openFile(const QString& fileName)
 {
 	if (!fileName.isEmpty())
 	{
-		MemPackItems newItems = loadAllItems(fileName);
-		memPackModel->setItems(newItems);
+		const MemPackLoadResult result = MemPackLoader::loadFile(fileName);
+		reportLoadProblems(tr("Open File"), { result });
+		if (!result.errorString.isEmpty()) return false;
+
+		memPackModel->setItems(result.items);
+		memPackModel->markLoaded();
+		ui.statusBar->showMessage(tr("Opened %1.").arg(fileName));
 
 		lastFileName = fileName;
 		updateWindowTitle();
@@ -131,6 +210,25 @@ bool MainWindow::openFile(const QString& fileName)
 	return false;
 }
 
+// ----------------------------------------------------------------------------
+void MainWindow::openImage(const QByteArray& pack, const QString& fileName, bool saved)
+{
+	// load straight from memory instead of reading back a file that was just written
+	MemPackLoadResult result = MemPackLoader::loadImage(PackImagePtr(new PackImage(pack)));
+	result.path = fileName;
+	reportLoadProblems(tr("Open File"), { result });
+
+	memPackModel->setItems(result.items);
+
+	lastFileName = fileName;
+	updateWindowTitle();
+	updateBlockCount();
+
+	// an image that never made it to disk (or failed to) counts as unsaved changes
+	if (saved) memPackModel->markLoaded();
+	setWindowModified(!saved);
+}
+
 // ----------------------------------------------------------------------------
 bool MainWindow::promptSave()
 {
@@ -170,29 +268,85 @@ bool MainWindow::saveFile(const QString &fileName)
 {
 	if (fileName.isEmpty()) return false; // no file open/selected
 
-	QTemporaryFile tempFile;
-	if (tempFile.open())
+	// packs being loaded or exported in the background are still open until that's done,
+	// and the file being saved over may be one of them
+	if (loadWatcher->isRunning() || exportWatcher->isRunning())
+	{
+		QMessageBox::warning(this, tr("Save File"), tr("Please wait until files are finished loading or exporting."));
+		return false;
+	}
+
+	// refuse to save rather than write a header that leaves out part of a file
+	// (checked before rearranging anything, so a refused save leaves the list alone)
+	const PackLayout layout = planLayout();
+	const int splitRow = layout.findSplitFile(memPackModel->items());
+	if (splitRow >= 0)
 	{
-		// TODO: support multiple sizes of memory pack - currently assume 8 blocks
-		// (saving larger ones will work, but should probably round out to a guaranteed power of two)
-		uint8 *emptyFlash = new uint8[1 << 20];
-		memset(emptyFlash, 0xff, 1 << 20);
+		QMessageBox::critical(this, tr("Save File"),
+			tr("Unable to save %1.\n\n\"%2\" would cross a 32-block boundary, which its header can't describe. "
+			   "Move or remove files before it so that it fits within one 32-block section.")
+			.arg(fileName, memPackModel->items()[splitRow].title));
+		return false;
+	}
+
+	if (!layout.isListOrder())
+	{
+		memPackModel->reorder(layout.order);
+	}
 
-		bool ok = (tempFile.write((const char*)emptyFlash, 1 << 20) == (1 << 20));
-		delete[] emptyFlash;
+	// if only some blocks of the currently open file changed, just rewrite those
+	const unsigned packSize = memPackModel->packSize();
+	const bool compressed = QFileInfo(fileName).suffix().compare("bsz", Qt::CaseInsensitive) == 0;
+	if (!compressed && fileName == lastFileName && !memPackModel->needsFullSave()
+		&& QFileInfo(fileName).size() == packSize)
+	{
+		return patchFile(fileName);
+	}
 
+	// written to a temporary file next to the destination, which then replaces it in one step
+	// (so a failed save never leaves a half-written or missing file behind)
+	QSaveFile file(fileName);
+	if (file.open(QIODevice::WriteOnly))
+	{
+		// compressed packs are put together in memory first, then compressed all at once
+		QByteArray image;
+		QBuffer buffer(&image);
+		QIODevice &out = compressed ? (QIODevice&)buffer : (QIODevice&)file;
+		bool ok = !compressed || buffer.open(QIODevice::WriteOnly);
 		unsigned offset = 0;
 
 		for (auto& item : memPackModel->items())
 		{
-			ok &= item.saveToFile(tempFile, offset);
-			offset += item.data.size();
+			ok &= item.saveToFile(out, offset);
+			offset += item.dataSize();
+		}
+
+		// erase the rest of the pack, one block at a time
+		for (; ok && offset < packSize; offset = (offset | ((1 << 17) - 1)) + 1)
+		{
+			const unsigned size = (1 << 17) - (offset & ((1 << 17) - 1));
+			ok &= out.write(erasedBlock().constData(), size) == size;
+		}
+
+		if (ok && compressed)
+		{
+			buffer.close();
+			ok = PackContainer::write(file, image);
+		}
+
+		// the file being replaced can't still be mapped (at least on Windows),
+		// so anything that still refers to it needs its own copy of its data first
+		for (auto& item : memPackModel->items())
+		{
+			if (item.source && QFileInfo(item.source->fileName()) == QFileInfo(fileName))
+			{
+				item.detach();
+			}
 		}
 
-		if (ok)
+		if (ok && file.commit())
 		{
-			QFile::remove(fileName);
-			tempFile.copy(fileName);
+			memPackModel->markSaved();
 
 			lastFileName = fileName;
 			updateWindowTitle();
@@ -201,10 +355,93 @@ bool MainWindow::saveFile(const QString &fileName)
 			setWindowModified(false);
 			return true;
 		}
-		else
+	}
+
+	QMessageBox::critical(this, tr("Save File"), tr("Unable to save %1: %2").arg(fileName, file.errorString()));
+	return false;
+}
+
+// ----------------------------------------------------------------------------
+bool MainWindow::patchFile(const QString &fileName)
+{
+	const BlockMap dirtyBlocks = memPackModel->dirtyBlocks();
+	MemPackItems &items = memPackModel->items();
+
+	QFile file(fileName);
+	bool ok = file.open(QIODevice::ReadWrite);
+
+	// unchanged items may still refer to the file being written, but only to blocks that aren't
+	// about to be overwritten. anything that did change is serialized before writing anything,
+	// since its old data might be in a block that something else is moving into
+	QVector<QByteArray> newData(items.size());
+	BlockMap itemBlocks;
+	unsigned offset = 0;
+	for (int row = 0; row < items.size(); row++)
+	{
+		MemPackItem &item = items[row];
+
+		BlockMap blocks;
+		blocks.setRange(offset >> 17, (item.dataSize() + (1 << 17) - 1) >> 17);
+
+		if (blocks.intersects(dirtyBlocks))
 		{
-			QMessageBox::critical(this, tr("Save File"), tr("Unable to save %1.").arg(fileName));
+			// anything that moved won't find its data where it used to be afterwards
+			if (item.source && (unsigned)item.sourceBlocks.findFirstSet() << 17 != offset)
+			{
+				item.detach();
+			}
+			newData[row] = item.serialize(offset);
 		}
+
+		itemBlocks |= blocks;
+		offset += item.dataSize();
+	}
+
+	offset = 0;
+	for (int row = 0; row < items.size(); row++)
+	{
+		MemPackItem &item = items[row];
+		const unsigned firstBlock = offset >> 17;
+		const unsigned numBlocks = (item.dataSize() + (1 << 17) - 1) >> 17;
+
+		for (unsigned i = 0; ok && i < numBlocks; i++)
+		{
+			if (dirtyBlocks.test(firstBlock + i))
+			{
+				const QByteArray block = newData[row].mid(i << 17, 1 << 17);
+				ok &= file.seek((firstBlock + i) << 17) && file.write(block) == block.size();
+			}
+		}
+
+		if (!newData[row].isNull() && !item.placeholder)
+		{
+			item.header = item.headerFor(offset);
+		}
+		offset += item.dataSize();
+	}
+
+	// erase anything that's not used anymore (e.g. after deleting a file)
+	for (int i = dirtyBlocks.findFirstSet(); ok && i >= 0; i = dirtyBlocks.findFirstSet(i + 1))
+	{
+		if (!itemBlocks.test(i) && ((qint64)i << 17) < file.size())
+		{
+			ok &= file.seek(i << 17) && file.write(erasedBlock()) == erasedBlock().size();
+		}
+	}
+
+	ok &= file.flush();
+
+	if (ok)
+	{
+		memPackModel->markSaved();
+
+		ui.statusBar->showMessage(tr("Saved %1 (%n block(s) updated).", "", dirtyBlocks.count()).arg(fileName));
+		setWindowModified(false);
+		return true;
+	}
+	else
+	{
+		QMessageBox::critical(this, tr("Save File"), tr("Unable to save %1.").arg(fileName));
 	}
 
 	return false;
@@ -214,7 +451,7 @@ bool MainWindow::saveFile(const QString &fileName)
 bool MainWindow::saveFileAs()
 {
 	const QString fileName = QFileDialog::getSaveFileName(this, tr("Save File As"),
-		lastFileName, tr("(*.bs)"));
+		lastFileName, tr("Memory pack (*.bs);;Compressed memory pack (*.bsz)"));
 	return saveFile(fileName);
 }
 
@@ -226,22 +463,17 @@ void MainWindow::exportSelected()
 
 	if (row >= 0 && row < memPackModel->rowCount())
 	{
-		MemPackItem &item = items[row];
-		ItemHeader &header = item.header;
+		const MemPackItem &item = items[row];
 
-		QString fileName = item.title.trimmed() + ".bs";
 		const QString filePath = QFileDialog::getSaveFileName(this, tr("Save File As"),
-			QFileInfo(lastFileName).dir().filePath(fileName), tr("(*.bs)"));
+			QFileInfo(lastFileName).dir().filePath(MemPackExporter::fileName(item)), tr("(*.bs)"));
 
 		if (!filePath.isEmpty())
 		{
-			QTemporaryFile tempFile;
-			if (tempFile.open())
+			const QString error = MemPackExporter::exportItem({ item, filePath });
+			if (!error.isEmpty())
 			{
-				item.saveToFile(tempFile);
-
-				QFile::remove(filePath);
-				tempFile.copy(filePath);
+				QMessageBox::critical(this, tr("Export"), tr("Unable to save %1.").arg(error));
 			}
 		}
 	}
@@ -250,33 +482,141 @@ void MainWindow::exportSelected()
 // ----------------------------------------------------------------------------
 void MainWindow::exportAll()
 {
+	if (exportWatcher->isRunning() || memPackModel->rowCount() == 0) return;
+
 	const QString outPath = QFileDialog::getExistingDirectory(this, tr("Export Files"), lastFileName);
 
 	if (!outPath.isEmpty())
 	{
-		MemPackItems &items = memPackModel->items();
-		QDir dir(outPath);
+		// the jobs have their own copies of the items, so the model is left alone while they run
+		const QVector<MemPackExportJob> jobs = MemPackExporter::plan(memPackModel->items(), QDir(outPath));
+		if (jobs.isEmpty())
+		{
+			ui.statusBar->showMessage(tr("There are no files to export."));
+			return;
+		}
+
+		showProgress(tr("Exporting files..."), exportWatcher, jobs.size());
+		exportWatcher->setFuture(QtConcurrent::mapped(jobs, &MemPackExporter::exportItem));
+	}
+}
+
+// ----------------------------------------------------------------------------
+void MainWindow::exportArchive()
+{
+	if (exportWatcher->isRunning() || memPackModel->rowCount() == 0) return;
+
+	QString defaultPath = lastFileName;
+	if (!defaultPath.isEmpty())
+	{
+		defaultPath = QFileInfo(lastFileName).dir().filePath(QFileInfo(lastFileName).completeBaseName() + ".zip");
+	}
+
+	const QString filePath = QFileDialog::getSaveFileName(this, tr("Export Files"),
+		defaultPath, tr("Zip archive (*.zip)"));
 
-		for (MemPackItem& item : items)
+	if (!filePath.isEmpty())
+	{
+		// written in one pass straight into the archive, with no separate file per item
+		const QVector<MemPackExportJob> jobs = MemPackExporter::plan(memPackModel->items(), QDir());
+		if (jobs.isEmpty())
 		{
-			ItemHeader &header = item.header;
+			ui.statusBar->showMessage(tr("There are no files to export."));
+			return;
+		}
 
-			QString fileName = item.title.trimmed() + ".bs";
-			const QString filePath = dir.filePath(fileName);
+		archivePath = filePath;
+		archiveFiles = jobs.size();
+		showProgress(tr("Exporting files..."), exportWatcher, 0);
+		exportWatcher->setFuture(QtConcurrent::run(&MemPackExporter::exportArchive, jobs, filePath));
+	}
+}
 
-			if (!filePath.isEmpty())
-			{
-				QTemporaryFile tempFile;
-				if (tempFile.open())
-				{
-					item.saveToFile(tempFile);
-
-					QFile::remove(filePath);
-					tempFile.copy(filePath);
-				}
-			}
+// ----------------------------------------------------------------------------
+void MainWindow::exportAllFinished()
+{
+	hideProgress();
+
+	if (!archivePath.isEmpty())
+	{
+		// a cancelled task never stores its result
+		const QString error = exportWatcher->future().resultCount() > 0 ? exportWatcher->result()
+			: tr("%1: the export was interrupted").arg(QDir::toNativeSeparators(archivePath));
+		if (error.isEmpty())
+		{
+			ui.statusBar->showMessage(tr("Exported %n file(s) to %1.", "", archiveFiles).arg(archivePath));
 		}
+		else
+		{
+			QMessageBox::critical(this, tr("Export"), tr("Unable to save %1.").arg(error));
+		}
+
+		archivePath.clear();
+		return;
 	}
+
+	if (exportWatcher->isCanceled())
+	{
+		ui.statusBar->showMessage(tr("Cancelled exporting files."));
+		return;
+	}
+
+	QStringList errors;
+	int numExported = 0;
+	for (const QString& error : exportWatcher->future().results())
+	{
+		if (error.isEmpty()) numExported++;
+		else errors.append(error);
+	}
+
+	if (!errors.isEmpty())
+	{
+		QMessageBox box(QMessageBox::Critical, tr("Export"),
+			tr("%n file(s) couldn't be exported.", "", errors.size()), QMessageBox::Ok, this);
+		box.setDetailedText(errors.join('\n'));
+		box.exec();
+	}
+
+	ui.statusBar->showMessage(tr("Exported %n file(s).", "", numExported));
+}
+
+// ----------------------------------------------------------------------------
+void MainWindow::recoverFiles()
+{
+	const QString indexPath = QFileDialog::getOpenFileName(this, tr("Open Block Index"),
+		lastFileName, tr("Block index (*.bsidx)"));
+	if (indexPath.isEmpty()) return;
+
+	BlockIndex index;
+	if (!index.load(indexPath))
+	{
+		QMessageBox::critical(this, tr("Recover Unknown Data"), index.errorString());
+		return;
+	}
+
+	MemPackItems items = memPackModel->items();
+	const MemPackItems recovered = MemPackLoader::recover(items, index);
+
+	if (recovered.isEmpty())
+	{
+		QMessageBox::information(this, tr("Recover Unknown Data"),
+			tr("None of the unknown data matches any file in this index."));
+		return;
+	}
+
+	int incomplete = 0;
+	for (const auto& item : recovered)
+	{
+		if (item.integrity == MemPackItem::ChecksumBad) incomplete++;
+	}
+
+	memPackModel->setItems(items);
+	updateBlockCount();
+	setWindowModified(true);
+
+	QMessageBox::information(this, tr("Recover Unknown Data"),
+		tr("Recovered %n file(s).", "", recovered.size())
+		+ (incomplete ? "\n\n" + tr("%n of them are incomplete, since some of their data was overwritten.", "", incomplete) : QString()));
 }
 
 // ----------------------------------------------------------------------------
@@ -285,7 +625,10 @@ void MainWindow::transferTest()
 	if (!promptSave()) return;
 
 	USBDumpDialog dumpDialog(USBDevice::INLRetro, this);
-	openFile(dumpDialog.dump());
+	if (dumpDialog.dump())
+	{
+		openImage(dumpDialog.image(), dumpDialog.outputPath(), dumpDialog.saved());
+	}
 }
 
 // ----------------------------------------------------------------------------
@@ -299,7 +642,8 @@ void MainWindow::updateSelected()
 		const MemPackItem &item = items[row];
 		const ItemHeader &header = item.header;
 
-		ui.infoWidget->setEnabled(true);
+		// leftover data has no header to edit
+		ui.infoWidget->setEnabled(!item.placeholder);
 
 		ui.editTitle->setText(item.title);
 		ui.spinBoxMonth->setValue(header.month >> 4);
@@ -330,6 +674,11 @@ void MainWindow::updateSelected()
 			ui.checkRunPSRAM->setChecked(true);
 			ui.labelWarning->setText("");
 		}
+		else if (ui.actionOptimizePlacement->isChecked() && planLayout().order.value(0) == row)
+		{
+			ui.checkRunPSRAM->setChecked(false);
+			ui.labelWarning->setText(tr("This file will be moved to the start of the Memory Pack when saving."));
+		}
 		else
 		{
 			ui.checkRunPSRAM->setChecked(false);
@@ -386,23 +735,100 @@ void MainWindow::applyChanges()
 // ----------------------------------------------------------------------------
 void MainWindow::addFiles()
 {
-	QString fileName = QFileDialog::getOpenFileName(this, tr("Add File"),
-		lastFileName, tr("(*.sfc *.bs)"));
+	const QStringList fileNames = QFileDialog::getOpenFileNames(this, tr("Add File"),
+		lastFileName, tr("(*.sfc *.bs *.bsz)"));
 
-	if (!fileName.isEmpty())
+	addFiles(fileNames);
+}
+
+// ----------------------------------------------------------------------------
+void MainWindow::addFiles(const QStringList& fileNames)
+{
+	if (fileNames.isEmpty() || loadWatcher->isRunning()) return;
+
+	showProgress(tr("Adding files..."), loadWatcher, fileNames.size());
+
+	// scan each pack on the thread pool; results are merged in order once they're all done
+	loadWatcher->setFuture(QtConcurrent::mapped(fileNames, &MemPackLoader::loadFile));
+}
+
+// ----------------------------------------------------------------------------
+void MainWindow::addFilesFinished()
+{
+	hideProgress();
+
+	if (loadWatcher->isCanceled())
 	{
-		MemPackItems &items = memPackModel->items();
-		items += loadAllItems(fileName);
+		releaseResults(loadWatcher);
+		ui.statusBar->showMessage(tr("Cancelled adding files."));
+		return;
+	}
 
-		memPackModel->setItems(items);
+	const QVector<MemPackLoadResult> results = loadWatcher->future().results().toVector();
+	// the future would otherwise keep every loaded pack open, even after its items are removed
+	releaseResults(loadWatcher);
+	reportLoadProblems(tr("Add File"), results);
 
-		ui.statusBar->showMessage(tr("Opened %1.").arg(fileName));
+	MemPackItems newItems;
+	int numOpened = 0;
+	for (const auto& result : results)
+	{
+		if (result.errorString.isEmpty())
+		{
+			newItems += result.items;
+			numOpened++;
+		}
+	}
+
+	if (numOpened > 0)
+	{
+		memPackModel->appendItems(newItems);
+
+		if (results.size() == 1)
+		{
+			ui.statusBar->showMessage(tr("Opened %1.").arg(results.first().path));
+		}
+		else
+		{
+			ui.statusBar->showMessage(tr("Added %n file(s) from %1 pack(s).", "", newItems.size()).arg(numOpened));
+		}
 
 		updateBlockCount();
 		setWindowModified(true);
 	}
 }
 
+// ----------------------------------------------------------------------------
+void MainWindow::showProgress(const QString& label, QFutureWatcherBase *watcher, int count)
+{
+	// only shows up if the work takes more than a moment
+	progress = new QProgressDialog(label, tr("Cancel"), 0, count, this);
+	progress->setWindowModality(Qt::WindowModal);
+	progress->setMinimumDuration(500);
+
+	// with no count, there's no way to tell how far along things are or to stop early
+	// (the dialog can still be closed, but that mustn't cancel a task that can't be stopped)
+	connect(watcher, SIGNAL(progressValueChanged(int)), progress, SLOT(setValue(int)));
+	if (count == 0)
+	{
+		progress->setCancelButton(nullptr);
+	}
+	else
+	{
+		connect(progress, SIGNAL(canceled()), watcher, SLOT(cancel()));
+	}
+}
+
+// ----------------------------------------------------------------------------
+void MainWindow::hideProgress()
+{
+	if (progress)
+	{
+		progress->deleteLater();
+		progress = nullptr;
+	}
+}
+
 // ----------------------------------------------------------------------------
 void MainWindow::deleteFile()
 {
@@ -443,74 +869,130 @@ void MainWindow::updateWindowTitle()
 // ----------------------------------------------------------------------------
 void MainWindow::updateBlockCount()
 {
-	unsigned blocks = 0;
-	for (const auto& item : memPackModel->items())
+	BlockMap unknownBlocks;
+	const BlockMap blocks = memPackModel->blockMap(&unknownBlocks);
+
+	QString text;
+	if (unknownBlocks.isEmpty())
 	{
-		blocks += item.blocks;
+		text = tr("%1 blocks used").arg(blocks.count());
+	}
+	else
+	{
+		text = tr("%1 blocks used (%2 unknown)").arg(blocks.count()).arg(unknownBlocks.count());
 	}
 
-	ui.labelBlockUsage->setText(tr("%1 blocks used").arg(blocks));
-}
-
-// ----------------------------------------------------------------------------
-MemPackItems MainWindow::loadAllItems(const QString& path)
-{
-	MemPackItems newItems;
+	// show where everything will end up when saved
+	const MemPackItems &items = memPackModel->items();
+	const PackLayout layout = planLayout();
+	const unsigned totalBlocks = memPackModel->packSize() >> 17;
 
-	if (!path.isEmpty())
+	QString map(totalBlocks, QChar('.'));
+	QStringList lines;
+	for (int i = 0; i < layout.order.size(); i++)
 	{
-		QFile file(path);
+		const int row = layout.order[i];
+		const MemPackItem &item = items[row];
+		const unsigned first = layout.offsets[row] >> 17;
+		const QChar symbol = item.placeholder ? QChar('?') : QChar('A' + i % 26);
 
-		if (!file.open(QIODevice::ReadOnly))
+		for (unsigned block = first; block < first + item.blocks && block < totalBlocks; block++)
+		{
+			map[block] = symbol;
+		}
+		if (item.blocks)
 		{
-			QMessageBox::critical(this, tr("Open File"),
-				tr("Couldn't open %1.").arg(path));
-			return newItems;
+			lines.append(tr("%1  blocks %2-%3  %4").arg(symbol).arg(first).arg(first + item.blocks - 1)
+				.arg(item.title.toHtmlEscaped()));
 		}
+	}
 
-		quint32 blocks = 0;
-		unsigned totalBlocks = file.size() >> 17;
-		bool recoveryWarning = false;
+	if (!layout.isListOrder())
+	{
+		text += tr(", rearranged when saving");
+	}
+	else if (layout.hasMisplacedFiles(items))
+	{
+		text += tr(", some files are too large for their position");
+	}
 
-		for (int i = 0; i < totalBlocks; i++)
-		{
-			// find the next block that hasn't been loaded as part of a file yet
-			if (blocks & (1 << i)) continue;
+	if (layout.findSplitFile(items) >= 0)
+	{
+		text += tr(", can't be saved (a file crosses a 32-block boundary)");
+	}
 
-			const unsigned blockStart = i << 17;
+	ui.labelBlockUsage->setText(text);
+	ui.labelBlockUsage->setToolTip(QString("<pre>%1\n\n%2</pre>").arg(map, lines.join('\n')));
+}
 
-			MemPackItem newItem;
-			if (newItem.tryLoadFrom(file, blockStart + 0x7fb0)
-				|| newItem.tryLoadFrom(file, blockStart + 0xffb0))
-			{
-				// issue some kind of warning if a file's block allocation overlaps another file
-				// (e.g. the dump of kirby guruguru ball in no-intro which has dupe files w/ wrong blocks)
-				if (blocks & newItem.header.blocks)
-				{
-					recoveryWarning = true;
-				}
-				
-				newItems.append(newItem);
-
-				blocks |= MemPackItem::normalizeBlocks(newItem.header.blocks, file.size());
-			}
-		}
-		// TODO: try to show placeholder entries for non-empty leftover 'junk' blocks
+// ----------------------------------------------------------------------------
+PackLayout MainWindow::planLayout() const
+{
+	return PackLayout::plan(memPackModel->items(), ui.actionOptimizePlacement->isChecked());
+}
+
+// ----------------------------------------------------------------------------
+void MainWindow::reportLoadProblems(const QString& title, const QVector<MemPackLoadResult>& results)
+{
+	if (results.size() == 1)
+	{
+		const MemPackLoadResult &result = results.first();
 
-		if (recoveryWarning)
+		if (!result.errorString.isEmpty())
+		{
+			QMessageBox::critical(this, title,
+				tr("Couldn't open %1.").arg(result.path));
+		}
+		else if (result.overlapping)
 		{
-			QMessageBox::warning(this, tr("Open File"),
+			QMessageBox::warning(this, title,
 				tr("At least one file in this memory pack seems to have been partially overwritten.\n\n"
 				   "Fully recovering all files may not be possible."));
 		}
-		else if (newItems.count() == 0)
+		else if (result.numFiles == 0)
 		{
-			QMessageBox::warning(this, tr("Open File"),
+			QMessageBox::warning(this, title,
 				tr("No valid BS-X files were found in this memory pack."));
 		}
+		else if (result.badChecksums)
+		{
+			QMessageBox::warning(this, title,
+				tr("%n file(s) in this memory pack failed checksum validation.\n\n"
+				   "The data may be corrupted.", "", result.badChecksums));
+		}
+		return;
+	}
 
-		ui.statusBar->showMessage(tr("Opened %1.").arg(path));
+	// when loading several packs at once, sum everything up in one message instead
+	QStringList problems;
+	for (const auto& result : results)
+	{
+		const QString name = QFileInfo(result.path).fileName();
+
+		if (!result.errorString.isEmpty())
+		{
+			problems.append(tr("%1: couldn't open (%2)").arg(name, result.errorString));
+		}
+		else if (result.overlapping)
+		{
+			problems.append(tr("%1: partially overwritten").arg(name));
+		}
+		else if (result.numFiles == 0)
+		{
+			problems.append(tr("%1: no valid BS-X files").arg(name));
+		}
+		else if (result.badChecksums)
+		{
+			problems.append(tr("%1: %n file(s) failed checksum validation", "", result.badChecksums).arg(name));
+		}
 	}
 
-	return newItems;
+	if (!problems.isEmpty())
+	{
+		QMessageBox box(QMessageBox::Warning, title,
+			tr("Problems were found in %n of the selected memory pack(s).", "", problems.size()),
+			QMessageBox::Ok, this);
+		box.setDetailedText(problems.join('\n'));
+		box.exec();
+	}
 }
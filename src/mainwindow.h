@@ -1,11 +1,14 @@
 #pragma once
 
 #include <QtWidgets/QMainWindow>
+#include <qfuturewatcher.h>
 #include "ui_mainwindow.h"
 
-#include "mempackitem.h"
+#include "mempackloader.h"
+#include "packlayout.h"
 
 class MemPackModel;
+class QProgressDialog;
 
 class MainWindow : public QMainWindow
 {
@@ -16,6 +19,8 @@ public:
 
 protected:
 	void closeEvent(QCloseEvent*);
+	void dragEnterEvent(QDragEnterEvent*);
+	void dropEvent(QDropEvent*);
 
 private slots:
 	void about();
@@ -27,13 +32,18 @@ private slots:
 
 	void exportSelected();
 	void exportAll();
+	void exportArchive();
+	void exportAllFinished();
+	void recoverFiles();
 
 	void transferTest();
 
 	void updateSelected();
+	void updateBlockCount();
 	void applyChanges();
 
 	void addFiles();
+	void addFilesFinished();
 	void deleteFile();
 	void moveFileUp();
 	void moveFileDown();
@@ -41,14 +51,25 @@ private slots:
 private:
 	bool promptSave();
 	bool openFile(const QString&);
+	void openImage(const QByteArray&, const QString&, bool saved);
 	bool saveFile(const QString&);
+	bool patchFile(const QString&);
 	void updateWindowTitle();
-	void updateBlockCount();
+	PackLayout planLayout() const;
 
-	MemPackItems loadAllItems(const QString& path);
+	void addFiles(const QStringList&);
+	void showProgress(const QString& label, QFutureWatcherBase *watcher, int count);
+	void hideProgress();
+	void reportLoadProblems(const QString& title, const QVector<MemPackLoadResult>&);
 
 	MemPackModel *memPackModel;
 
+	QFutureWatcher<MemPackLoadResult> *loadWatcher;
+	QFutureWatcher<QString> *exportWatcher;
+	QProgressDialog *progress;
+	QString archivePath; // set while exporting to an archive
+	int archiveFiles;
+
 	QString lastFileName;
 	Ui::MainWindow ui;
 };
@@ -0,0 +1,107 @@
+#include "mempackexport.h"
+#include "zipwriter.h"
+
+#include <qtconcurrentmap.h>
+#include <qfileinfo.h>
+#include <qsavefile.h>
+#include <qset.h>
+#include <qthread.h>
+
+// ----------------------------------------------------------------------------
+QString MemPackExporter::fileName(const MemPackItem &item)
+{
+	QString name = item.title.trimmed();
+	for (QChar &ch : name)
+	{
+		if (ch < QChar(0x20) || QString("\\/:*?\"<>|").contains(ch))
+		{
+			ch = '_';
+		}
+	}
+
+	if (name.isEmpty()) name = "Untitled";
+	return name + ".bs";
+}
+
+// ----------------------------------------------------------------------------
+QVector<MemPackExportJob> MemPackExporter::plan(const MemPackItems &items, const QDir &dir, QSet<QString> *usedNames)
+{
+	QVector<MemPackExportJob> jobs;
+	QSet<QString> localNames;
+	if (!usedNames) usedNames = &localNames;
+
+	for (const auto& item : items)
+	{
+		// leftover data isn't a file of its own
+		if (item.placeholder) continue;
+
+		const QString name = fileName(item);
+		const QString baseName = name.left(name.size() - 3);
+
+		// "Title.bs", "Title (2).bs", "Title (3).bs", etc.
+		// (compared case-insensitively, since the files may end up on a filesystem that is)
+		QString uniqueName = name;
+		for (int num = 2; usedNames->contains(uniqueName.toLower()); num++)
+		{
+			uniqueName = QString("%1 (%2).bs").arg(baseName).arg(num);
+		}
+		usedNames->insert(uniqueName.toLower());
+
+		jobs.append({ item, dir.filePath(uniqueName) });
+	}
+
+	return jobs;
+}
+
+// ----------------------------------------------------------------------------
+QString MemPackExporter::exportItem(const MemPackExportJob &job)
+{
+	QSaveFile file(job.path);
+	if (!file.open(QIODevice::WriteOnly) || !job.item.writeTo(file) || !file.commit())
+	{
+		return QString("%1: %2").arg(QDir::toNativeSeparators(job.path), file.errorString());
+	}
+
+	return QString();
+}
+
+// ----------------------------------------------------------------------------
+static ZipWriter::Entry compressJob(const MemPackExportJob &job)
+{
+	return ZipWriter::compress(QFileInfo(job.path).fileName(), job.item.serialize());
+}
+
+// ----------------------------------------------------------------------------
+QString MemPackExporter::exportArchive(const QVector<MemPackExportJob> &jobs, const QString &path)
+{
+	QSaveFile file(path);
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		return QString("%1: %2").arg(QDir::toNativeSeparators(path), file.errorString());
+	}
+
+	ZipWriter zip(&file);
+
+	// compress a few entries at a time across all cores, then write them in order,
+	// so only a handful of items are ever held in memory at once
+	const int batchSize = qMax(1, QThread::idealThreadCount()) * 2;
+	bool ok = true;
+
+	for (int i = 0; ok && i < jobs.size(); i += batchSize)
+	{
+		const QList<ZipWriter::Entry> entries =
+			QtConcurrent::blockingMapped<QList<ZipWriter::Entry>>(jobs.mid(i, batchSize), compressJob);
+
+		for (const auto& entry : entries)
+		{
+			if (!(ok = zip.addEntry(entry))) break;
+		}
+	}
+
+	if (!ok || !zip.finish() || !file.commit())
+	{
+		return QString("%1: %2").arg(QDir::toNativeSeparators(path), file.errorString());
+	}
+
+	return QString();
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <qdir.h>
+#include <qset.h>
+#include "mempackitem.h"
+
+// One item to be written out as its own single-file pack.
+// The item is a copy, so exporting never changes the items being shown or saved.
+struct MemPackExportJob
+{
+	MemPackItem item;
+	QString path;
+};
+
+class MemPackExporter
+{
+public:
+	// a file name for an item based on its title, with anything that isn't allowed in file names replaced
+	static QString fileName(const MemPackItem &item);
+	// exports every item except placeholders into a directory, numbering any files that would end up with the same name
+	// (as each other, or as any already in usedNames, which is updated with the new names)
+	static QVector<MemPackExportJob> plan(const MemPackItems &items, const QDir &dir, QSet<QString> *usedNames = nullptr);
+
+	// these return an error message, or an empty string if the file was written
+	static QString exportItem(const MemPackExportJob &job);
+	// writes every job into one zip file, using just the file name part of each job's path
+	static QString exportArchive(const QVector<MemPackExportJob> &jobs, const QString &path);
+};
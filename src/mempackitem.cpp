@@ -1,14 +1,29 @@
 #include "mempackitem.h"
+#include "blockscan.h"
 
 #include <cstring>
 #include <qtextcodec.h>
 
 // ----------------------------------------------------------------------------
-bool MemPackItem::tryLoadFrom(QFile& file, unsigned offset)
+static QTextCodec* shiftJISCodec()
+{
+	// looking up a codec by name is fairly slow, so only do it once
+	static QTextCodec *const codec = QTextCodec::codecForName("Shift-JIS");
+	return codec;
+}
+
+// ----------------------------------------------------------------------------
+static inline bool isPlainAscii(ushort ch)
+{
+	// 0x5c and 0x7e are yen/overline in JIS X 0201, so leave those to the codec
+	return ch >= 0x20 && ch < 0x7f && ch != 0x5c && ch != 0x7e;
+}
+
+// ----------------------------------------------------------------------------
+bool MemPackItem::tryLoadFrom(const PackImagePtr& pack, unsigned offset)
 {
-	file.seek(offset);
 	// try to read header
-	if (file.read((char*)&header, sizeof header) < sizeof header) return false;
+	if (!pack->read(offset, &header, sizeof header)) return false;
 
 	// try to detect a valid file...
 	// TODO: make this able to reject normal SNES ROMs...
@@ -28,38 +43,21 @@ bool MemPackItem::tryLoadFrom(QFile& file, unsigned offset)
 			|| ((header.checksum | header.checksumComp) == 0x0000)
 			|| header.blocks == 0xFFFFFFFF))
 	{
-		data.clear();
+		// find blocks based on the mapping bits
+		// TODO: possibly handle non-po2 file sizes here...
+		const unsigned totalBlocks = (pack->size() + (1 << 17) - 1) >> 17;
+		sourceBlocks = BlockMap::fromHeader(header.blocks, offset >> 17, totalBlocks);
+		sourceSize = 0;
 
-		// read blocks based on the mapping bits
-		quint32 blocksLeft = normalizeBlocks(header.blocks, file.size());
-		for (int i = 0; i < 32 && blocksLeft; i++)
+		for (int i = sourceBlocks.findFirstSet(); i >= 0; i = sourceBlocks.findFirstSet(i + 1))
 		{
-			if (blocksLeft & (1 << i))
-			{
-				blocksLeft &= ~(1 << i);
-
-				// TODO: possibly handle non-po2 file sizes here...
-				file.seek(i << 17);
-				data += file.read(1 << 17);
-			}
+			sourceSize += qMin(1u << 17, pack->size() - (i << 17));
 		}
 
-		char tempTitle[17];
-		memcpy(tempTitle, header.title, 16);
-		tempTitle[16] = '\0';
-
-		title = QTextCodec::codecForName("Shift-JIS")->toUnicode(tempTitle);
-		blocks = data.size() >> 17;
-		if (header.starts & (1 << 15))
-		{
-			starts = countBits(header.starts & 0x7fff);
-		}
-		else
-		{
-			starts = -1;
-		}
+		source = pack;
+		localData.clear();
 
-		deleted = header.makerFixed != 0x33;
+		loadHeader(sourceSize);
 		return true;
 	}
 
@@ -67,49 +65,290 @@ bool MemPackItem::tryLoadFrom(QFile& file, unsigned offset)
 }
 
 // ----------------------------------------------------------------------------
-bool MemPackItem::saveToFile(QFile& file, unsigned offset)
+void MemPackItem::loadPlaceholder(const PackImagePtr& pack, unsigned firstBlock, unsigned numBlocks)
 {
-	QByteArray encodedTitle = QTextCodec::codecForName("Shift-JIS")->fromUnicode(title);
-	memset(header.title, 0, 16);
-	strncpy(header.title, encodedTitle.constData(), 16);
+	memset(&header, 0, sizeof header);
 
-	const unsigned blockStart = offset >> 17;
-	unsigned newBlocks = 0;
-	for (unsigned i = blockStart; i < blockStart + (data.size() >> 17); i++)
+	sourceBlocks = BlockMap();
+	sourceBlocks.setRange(firstBlock, numBlocks);
+	sourceSize = numBlocks << 17;
+	source = pack;
+	localData.clear();
+
+	title = QString("Block %1").arg(firstBlock);
+	encodedTitle.clear();
+	encodedTitleSource.clear();
+	blocks = numBlocks;
+	starts = -1;
+
+	deleted = false;
+	placeholder = true;
+	integrity = NoChecksum;
+	cachedChecksumPos = -1;
+}
+
+// ----------------------------------------------------------------------------
+void MemPackItem::loadFromData(const ItemHeader& newHeader, const QByteArray& data)
+{
+	header = newHeader;
+
+	source.clear();
+	sourceBlocks = BlockMap();
+	sourceSize = 0;
+	localData = data;
+
+	loadHeader(localData.size());
+}
+
+// ----------------------------------------------------------------------------
+void MemPackItem::loadHeader(unsigned size)
+{
+	title = decodeTitle(header.title, sizeof header.title);
+	encodedTitle = QByteArray(header.title, qstrnlen(header.title, sizeof header.title));
+	encodedTitleSource = title;
+	blocks = size >> 17;
+	if (header.starts & (1 << 15))
+	{
+		starts = countBits(header.starts & 0x7fff);
+	}
+	else
+	{
+		starts = -1;
+	}
+
+	deleted = header.makerFixed != 0x33;
+	placeholder = false;
+	integrity = Unchecked;
+	cachedChecksumPos = -1;
+}
+
+// ----------------------------------------------------------------------------
+QByteArray MemPackItem::data() const
+{
+	if (!source) return localData;
+
+	// a view of the source image would be left dangling once the item is gone
+	QByteArray result = dataView();
+	result.detach();
+	return result;
+}
+
+// ----------------------------------------------------------------------------
+QByteArray MemPackItem::dataView() const
+{
+	if (!source) return localData;
+
+	const int firstBlock = sourceBlocks.findFirstSet();
+	const bool contiguous = firstBlock >= 0
+		&& sourceBlocks.findLastSet() - firstBlock + 1 == (int)sourceBlocks.count();
+
+	if (contiguous && source->data())
+	{
+		// usual case: refer to the blocks in the source image without copying them
+		// (this is only valid for as long as the source is, i.e. while this item exists)
+		return QByteArray::fromRawData((const char*)source->data() + (firstBlock << 17), sourceSize);
+	}
+
+	QByteArray result(sourceSize, (char)0xff);
+	unsigned offset = 0;
+	for (int block = firstBlock; block >= 0; block = sourceBlocks.findFirstSet(block + 1))
+	{
+		const unsigned size = qMin(1u << 17, sourceSize - offset);
+		source->read(block << 17, result.data() + offset, size);
+		offset += size;
+	}
+
+	return result;
+}
+
+// ----------------------------------------------------------------------------
+unsigned MemPackItem::dataSize() const
+{
+	return source ? sourceSize : localData.size();
+}
+
+// ----------------------------------------------------------------------------
+void MemPackItem::detach()
+{
+	if (source)
+	{
+		localData = data();
+
+		source.clear();
+		sourceBlocks = BlockMap();
+		sourceSize = 0;
+	}
+}
+
+// ----------------------------------------------------------------------------
+QByteArray MemPackItem::titleBytes() const
+{
+	if (encodedTitleSource != title || encodedTitle.isNull())
+	{
+		encodedTitle = encodeTitle(title);
+		encodedTitleSource = title;
+	}
+	return encodedTitle;
+}
+
+// ----------------------------------------------------------------------------
+QString MemPackItem::decodeTitle(const char *data, int maxLength)
+{
+	const int length = qstrnlen(data, maxLength);
+
+	// most titles are plain ASCII, which doesn't need to go through the codec at all
+	for (int i = 0; i < length; i++)
+	{
+		if (!isPlainAscii((uchar)data[i]))
+		{
+			return shiftJISCodec()->toUnicode(data, length);
+		}
+	}
+	return QString::fromLatin1(data, length);
+}
+
+// ----------------------------------------------------------------------------
+QByteArray MemPackItem::encodeTitle(const QString &title)
+{
+	for (const QChar ch : title)
 	{
-		newBlocks |= (1 << i);
+		if (!isPlainAscii(ch.unicode()))
+		{
+			return shiftJISCodec()->fromUnicode(title);
+		}
 	}
-	header.blocks = newBlocks;
+	return title.toLatin1();
+}
 
+// ----------------------------------------------------------------------------
+unsigned MemPackItem::headerOffset() const
+{
 	unsigned headerPos = 0x7fb0;
 	if (header.mapMode & 1)
 	{
 		headerPos |= 1 << 15;
 	}
-	memset(data.data() + headerPos, 0, sizeof header);
+	return headerPos;
+}
+
+// ----------------------------------------------------------------------------
+quint16 MemPackItem::computeChecksum() const
+{
+	// the header area itself is left out, since the checksum is stored there
+	const QByteArray payload = dataView();
+	const unsigned headerPos = headerOffset();
+
+	quint16 checksum = byteSum(payload.constData(), payload.size());
+	if (headerPos + sizeof header <= (unsigned)payload.size())
+	{
+		checksum -= byteSum(payload.constData() + headerPos, sizeof header);
+	}
+	return checksum;
+}
+
+// ----------------------------------------------------------------------------
+quint16 MemPackItem::checksum() const
+{
+	// none of the header fields are included, but the map mode decides where the header is
+	const int headerPos = headerOffset();
+	if (cachedChecksumPos != headerPos)
+	{
+		cachedChecksum = computeChecksum();
+		cachedChecksumPos = headerPos;
+	}
+	return cachedChecksum;
+}
+
+// ----------------------------------------------------------------------------
+void MemPackItem::validate()
+{
+	if (placeholder || deleted || (header.checksum | header.checksumComp) == 0)
+	{
+		integrity = NoChecksum;
+		return;
+	}
+
+	actualChecksum = checksum();
+	integrity = (actualChecksum == header.checksum) ? ChecksumOK : ChecksumBad;
+}
+
+// ----------------------------------------------------------------------------
+ItemHeader MemPackItem::headerFor(unsigned offset) const
+{
+	ItemHeader saved = header;
+
+	const QByteArray encodedTitle = titleBytes();
+	memset(saved.title, 0, 16);
+	strncpy(saved.title, encodedTitle.constData(), 16);
+
+	// the mask only covers the 32-block section the file starts in (see PackLayout::findSplitFile)
+	const unsigned blockStart = offset >> 17;
+	Q_ASSERT((blockStart & ~31) == (((offset + dataSize() - 1) >> 17) & ~31));
+	BlockMap newBlocks;
+	newBlocks.setRange(blockStart, dataSize() >> 17);
+	saved.blocks = newBlocks.toHeader(blockStart);
 
 	if (deleted)
 	{
-		header.makerFixed = 0;
+		saved.makerFixed = 0;
 	}
 	else
 	{
-		header.makerFixed = 0x33;
+		saved.makerFixed = 0x33;
 
-		quint16 checksum = 0;
-		for (int i = 0; i < data.size(); i++)
-		{
-			checksum += (uint8)data[i];
-		}
+		const quint16 sum = checksum();
+		saved.checksum = sum;
+		saved.checksumComp = ~sum;
+	}
 
-		header.checksum = checksum;
-		header.checksumComp = ~checksum;
+	return saved;
+}
+
+// ----------------------------------------------------------------------------
+QByteArray MemPackItem::serialize(unsigned offset) const
+{
+	QByteArray result = data();
+
+	if (!placeholder)
+	{
+		const ItemHeader saved = headerFor(offset);
+		memcpy(result.data() + headerOffset(), &saved, sizeof saved);
 	}
+	return result;
+}
 
-	memcpy(data.data() + headerPos, &header, sizeof header);
+// ----------------------------------------------------------------------------
+bool MemPackItem::writeTo(QIODevice& file, unsigned offset) const
+{
+	const QByteArray payload = dataView();
 
-	file.seek(offset);
-	return file.write(data) == data.size();
+	// leftover data has no header, and is written back as it was
+	if (placeholder)
+	{
+		return file.seek(offset) && file.write(payload) == payload.size();
+	}
+
+	// write around the header instead of patching it into a copy of the data
+	const ItemHeader saved = headerFor(offset);
+	const unsigned headerPos = headerOffset();
+	const unsigned restPos = headerPos + sizeof saved;
+
+	return file.seek(offset)
+		&& file.write(payload.constData(), headerPos) == headerPos
+		&& file.write((const char*)&saved, sizeof saved) == sizeof saved
+		&& file.write(payload.constData() + restPos, payload.size() - restPos) == payload.size() - restPos;
+}
+
+// ----------------------------------------------------------------------------
+bool MemPackItem::saveToFile(QIODevice& file, unsigned offset)
+{
+	if (!writeTo(file, offset)) return false;
+
+	if (!placeholder)
+	{
+		header = headerFor(offset);
+	}
+	return true;
 }
 
 // ----------------------------------------------------------------------------
@@ -124,18 +363,3 @@ unsigned MemPackItem::countBits(unsigned val)
 	return bits;
 }
 
-// ----------------------------------------------------------------------------
-unsigned MemPackItem::normalizeBlocks(quint32 blocks, unsigned packSize)
-{
-	unsigned totalBlocks = packSize >> 17;
-	quint32 mask = 0xffffffff;
-	uint shift = 16;
-	while (totalBlocks <= shift)
-	{
-		blocks |= (blocks >> shift);
-		mask >>= shift;
-		shift >>= 1;
-	}
-
-	return blocks & mask;
-}
@@ -3,6 +3,8 @@
 #include <qbytearray.h>
 #include <qfile.h>
 #include "endian.h"
+#include "blockmap.h"
+#include "packimage.h"
 
 #pragma pack(push, 1)
 struct ItemHeader
@@ -26,20 +28,79 @@ struct ItemHeader
 
 struct MemPackItem
 {
+	enum Integrity
+	{
+		Unchecked,
+		ChecksumOK,
+		ChecksumBad,
+		NoChecksum, // deleted, or saved without a checksum
+	};
+
 	ItemHeader header;
 
 	QString title;
 	unsigned blocks = 0;
 	int starts = -1;
 	bool deleted = false;
+
+	// leftover data that isn't part of any file; there's no valid header,
+	// so it's saved back exactly as it was found
+	bool placeholder = false;
+
+	Integrity integrity = Unchecked;
+	quint16 actualChecksum = 0;
+
+	// Shift-JIS version of the title and the title it was encoded from,
+	// so that saving an unchanged title doesn't have to encode it again
+	mutable QByteArray encodedTitle;
+	mutable QString encodedTitleSource;
+
+	// sum of the data outside of the header, and the header position it was calculated for.
+	// only changes if the data itself does, so it's only calculated once per item
+	mutable quint16 cachedChecksum = 0;
+	mutable int cachedChecksumPos = -1;
 	
-	QByteArray data;
+	// only the header is read when loading; the data itself stays in these blocks
+	// of the source image until something needs it (see dataView())
+	PackImagePtr source;
+	BlockMap sourceBlocks;
+	unsigned sourceSize = 0;
+
+	// private copy of the data, once detached from the source
+	QByteArray localData;
+
+	// a copy of the data that can be kept around for as long as needed
+	QByteArray data() const;
+	// the data without copying it from the source image if possible,
+	// so it's only valid for as long as this item is
+	QByteArray dataView() const;
+	unsigned dataSize() const;
+
+	bool tryLoadFrom(const PackImagePtr& pack, unsigned offset);
+	void loadPlaceholder(const PackImagePtr& pack, unsigned firstBlock, unsigned numBlocks);
+	void loadFromData(const ItemHeader& header, const QByteArray& data);
+	// sets everything else from the header, for a file with this much data
+	void loadHeader(unsigned size);
+	void detach();
+
+	QByteArray titleBytes() const;
+	unsigned headerOffset() const;
+	quint16 computeChecksum() const;
+	quint16 checksum() const;
+	void validate();
+
+	// the header and data as they'd be saved at the given offset in a pack,
+	// with the header filled in as it's written instead of changing the item
+	ItemHeader headerFor(unsigned offset) const;
+	QByteArray serialize(unsigned offset = 0) const;
+	bool writeTo(QIODevice& file, unsigned offset = 0) const;
+	// same as writeTo, but also updates the header to match what was saved
+	bool saveToFile(QIODevice& file, unsigned offset = 0);
 
-	bool tryLoadFrom(QFile& file, unsigned offset);
-	bool saveToFile(QFile& file, unsigned offset = 0);
+	static QString decodeTitle(const char *data, int maxLength);
+	static QByteArray encodeTitle(const QString &title);
 
 	static unsigned countBits(unsigned val);
-	static unsigned normalizeBlocks(quint32 blocks, unsigned packSize);
 };
 
 typedef QList<MemPackItem> MemPackItems;
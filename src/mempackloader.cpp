@@ -0,0 +1,282 @@
+#include "mempackloader.h"
+#include "blockindex.h"
+#include "blockscan.h"
+
+#include <qtconcurrentmap.h>
+#include <qdiriterator.h>
+#include <qfileinfo.h>
+
+// ----------------------------------------------------------------------------
+MemPackLoadResult MemPackLoader::loadFile(const QString &path)
+{
+	QSharedPointer<PackImage> pack(new PackImage);
+
+	if (!pack->open(path))
+	{
+		MemPackLoadResult result;
+		result.path = path;
+		result.errorString = pack->errorString();
+		return result;
+	}
+
+	MemPackLoadResult result = loadImage(pack);
+	result.path = path;
+	return result;
+}
+
+// ----------------------------------------------------------------------------
+MemPackLoadResult MemPackLoader::loadImage(const PackImagePtr &pack)
+{
+	MemPackLoadResult result;
+	result.path = pack->fileName();
+
+	if (pack->size() > 0)
+	{
+		unsigned totalBlocks = pack->size() >> 17;
+		BlockMap blocks(totalBlocks);
+
+		// find the next block that hasn't been loaded as part of a file yet
+		for (int i = blocks.findFirstClear(); i >= 0; i = blocks.findFirstClear(i + 1))
+		{
+			const unsigned blockStart = i << 17;
+
+			MemPackItem newItem;
+			if (newItem.tryLoadFrom(pack, blockStart + 0x7fb0)
+				|| newItem.tryLoadFrom(pack, blockStart + 0xffb0))
+			{
+				// issue some kind of warning if a file's block allocation overlaps another file
+				// (e.g. the dump of kirby guruguru ball in no-intro which has dupe files w/ wrong blocks)
+				if (blocks.intersects(newItem.sourceBlocks))
+				{
+					result.overlapping = true;
+				}
+
+				result.items.append(newItem);
+
+				blocks |= newItem.sourceBlocks;
+			}
+		}
+		result.numFiles = result.items.size();
+
+		// everything else is either erased or left over from deleted/overwritten files,
+		// and only the leftovers get placeholders
+		BlockMap orphanBlocks(totalBlocks);
+		QByteArray blockBuffer;
+
+		for (int i = blocks.findFirstClear(); i >= 0 && i < (int)totalBlocks; i = blocks.findFirstClear(i + 1))
+		{
+			bool erased;
+			if (pack->isCompressed())
+			{
+				// erased blocks aren't stored at all, so no need to decompress the others to tell
+				erased = pack->isErasedBlock(i);
+			}
+			else
+			{
+				const uchar *blockData = pack->data() ? pack->data() + (i << 17) : nullptr;
+				if (!blockData)
+				{
+					blockBuffer.resize(1 << 17);
+					if (!pack->read(i << 17, blockBuffer.data(), 1 << 17)) continue;
+					blockData = (const uchar*)blockBuffer.constData();
+				}
+				erased = isErased(blockData, 1 << 17);
+			}
+
+			if (!erased)
+			{
+				orphanBlocks.set(i);
+			}
+		}
+
+		appendPlaceholders(result.items, pack, orphanBlocks);
+
+		// check every file's data against its checksum, spread across all cores
+		// (when called from a pool thread, this thread also takes part instead of just waiting).
+		// compressed packs are only ever written by saving, which always writes correct checksums,
+		// so their files are left unchecked instead of decompressing every one of them here
+		if (!pack->isCompressed())
+		{
+			QtConcurrent::blockingMap(result.items, &MemPackItem::validate);
+		}
+
+		for (const auto& item : result.items)
+		{
+			if (item.integrity == MemPackItem::ChecksumBad) result.badChecksums++;
+		}
+	}
+
+	return result;
+}
+
+// ----------------------------------------------------------------------------
+void MemPackLoader::appendPlaceholders(MemPackItems &items, const PackImagePtr &pack, const BlockMap &orphanBlocks)
+{
+	// show each run of leftover blocks as one placeholder, so the data can still be recovered
+	for (int i = orphanBlocks.findFirstSet(); i >= 0; )
+	{
+		int end = orphanBlocks.findFirstClear(i);
+		if (end < 0) end = orphanBlocks.size();
+
+		MemPackItem placeholder;
+		placeholder.loadPlaceholder(pack, i, end - i);
+		items.append(placeholder);
+
+		i = orphanBlocks.findFirstSet(end);
+	}
+}
+
+// ----------------------------------------------------------------------------
+struct OrphanBlock
+{
+	PackImagePtr pack;
+	unsigned block;
+	QByteArray hash;
+};
+
+// ----------------------------------------------------------------------------
+static void hashOrphanBlock(OrphanBlock &orphan)
+{
+	if (orphan.pack->data())
+	{
+		orphan.hash = BlockIndex::hashBlock((const char*)orphan.pack->data() + (orphan.block << 17));
+	}
+	else
+	{
+		QByteArray buffer(1 << 17, (char)0xff);
+		if (orphan.pack->read(orphan.block << 17, buffer.data(), 1 << 17))
+		{
+			orphan.hash = BlockIndex::hashBlock(buffer.constData());
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+MemPackItems MemPackLoader::recover(MemPackItems &items, const BlockIndex &index)
+{
+	QVector<OrphanBlock> orphans;
+	for (const auto& item : items)
+	{
+		if (!item.placeholder || !item.source) continue;
+
+		for (int i = item.sourceBlocks.findFirstSet(); i >= 0; i = item.sourceBlocks.findFirstSet(i + 1))
+		{
+			orphans.append({ item.source, (unsigned)i, QByteArray() });
+		}
+	}
+
+	if (orphans.isEmpty()) return MemPackItems();
+
+	// hashing is the slow part, the lookups themselves are cheap
+	QtConcurrent::blockingMap(orphans, hashOrphanBlock);
+
+	// reassemble each file from whichever of its blocks were found.
+	// anything that was overwritten is left erased, so those files will fail validation
+	struct Recovered
+	{
+		PackImagePtr pack;
+		int file;
+		QByteArray data;
+		BlockMap packBlocks;
+		BlockMap fileBlocks;
+	};
+	QVector<Recovered> recovered;
+
+	for (const auto& orphan : orphans)
+	{
+		BlockIndex::Location location;
+		if (orphan.hash.isEmpty() || !index.lookup(orphan.hash, &location)) continue;
+
+		Recovered *file = nullptr;
+		for (auto& entry : recovered)
+		{
+			if (entry.pack == orphan.pack && entry.file == location.file)
+			{
+				file = &entry;
+				break;
+			}
+		}
+		if (!file)
+		{
+			const unsigned numBlocks = index.file(location.file).blocks;
+			recovered.append({ orphan.pack, location.file, QByteArray(numBlocks << 17, (char)0xff),
+				BlockMap(), BlockMap(numBlocks) });
+			file = &recovered.last();
+		}
+
+		// if the same block was left over more than once, only use the first one
+		if (location.block < file->fileBlocks.size() && !file->fileBlocks.test(location.block))
+		{
+			orphan.pack->read(orphan.block << 17, file->data.data() + (location.block << 17), 1 << 17);
+			file->fileBlocks.set(location.block);
+			file->packBlocks.set(orphan.block);
+		}
+	}
+
+	if (recovered.isEmpty()) return MemPackItems();
+
+	MemPackItems recoveredItems;
+	for (const auto& entry : recovered)
+	{
+		MemPackItem item;
+		item.loadFromData(index.file(entry.file).header, entry.data);
+		recoveredItems.append(item);
+	}
+	QtConcurrent::blockingMap(recoveredItems, &MemPackItem::validate);
+
+	// keep everything else in the same order, and split up what's still left of the placeholders
+	MemPackItems newItems, placeholders;
+	for (const auto& item : items)
+	{
+		if (!item.placeholder || !item.source)
+		{
+			(item.placeholder ? placeholders : newItems).append(item);
+			continue;
+		}
+
+		BlockMap leftover = item.sourceBlocks;
+		for (const auto& entry : recovered)
+		{
+			if (entry.pack != item.source) continue;
+
+			for (int i = entry.packBlocks.findFirstSet(); i >= 0; i = entry.packBlocks.findFirstSet(i + 1))
+			{
+				leftover.set(i, false);
+			}
+		}
+		appendPlaceholders(placeholders, item.source, leftover);
+	}
+
+	items = newItems + recoveredItems + placeholders;
+	return recoveredItems;
+}
+
+// ----------------------------------------------------------------------------
+QStringList MemPackLoader::findFiles(const QStringList &paths)
+{
+	QStringList files;
+
+	for (const QString &path : paths)
+	{
+		if (QFileInfo(path).isDir())
+		{
+			QStringList dirFiles;
+			QDirIterator it(path, QStringList() << "*.sfc" << "*.bs" << "*.bsz",
+				QDir::Files | QDir::Readable, QDirIterator::Subdirectories);
+			while (it.hasNext())
+			{
+				dirFiles.append(it.next());
+			}
+
+			// directory listing order depends on the filesystem
+			dirFiles.sort(Qt::CaseInsensitive);
+			files += dirFiles;
+		}
+		else
+		{
+			files.append(path);
+		}
+	}
+
+	return files;
+}
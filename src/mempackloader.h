@@ -0,0 +1,38 @@
+#pragma once
+
+#include <qstringlist.h>
+#include "mempackitem.h"
+#include "packimage.h"
+
+class BlockIndex;
+
+// Everything found when scanning one pack image.
+struct MemPackLoadResult
+{
+	QString path;
+	QString errorString; // set if the image couldn't be opened at all
+	MemPackItems items; // actual files first, then placeholders for any leftover data
+	int numFiles = 0;
+
+	bool overlapping = false; // some file's blocks were partially overwritten by another
+	int badChecksums = 0;
+};
+
+// Finds and validates the files in pack images. This doesn't touch the GUI,
+// so any number of packs can be loaded at once from a thread pool.
+class MemPackLoader
+{
+public:
+	static MemPackLoadResult loadFile(const QString &path);
+	static MemPackLoadResult loadImage(const PackImagePtr &pack);
+
+	// looks up the blocks of any placeholders in an index of known files, and replaces them
+	// with whichever files they turn out to belong to. returns the recovered files
+	static MemPackItems recover(MemPackItems &items, const BlockIndex &index);
+
+	// expands any directories into the pack images inside them, in a stable order
+	static QStringList findFiles(const QStringList &paths);
+
+private:
+	static void appendPlaceholders(MemPackItems &items, const PackImagePtr &pack, const BlockMap &orphanBlocks);
+};
@@ -1,11 +1,14 @@
 #include "mempackmodel.h"
 #include "mempackitem.h"
 
+#include <QApplication>
 #include <QIcon>
+#include <QStyle>
 
 // ----------------------------------------------------------------------------
 MemPackModel::MemPackModel(QObject *parent)
 	: QAbstractListModel(parent)
+	, fullSave(true)
 {
 
 }
@@ -21,6 +24,8 @@ QVariant MemPackModel::data(const QModelIndex& index, int role) const
 {
 	static const QIcon validFileIcon(":/res/accept.png");
 	static const QIcon deletedFileIcon(":/res/cancel.png");
+	static const QIcon corruptFileIcon(QApplication::style()->standardIcon(QStyle::SP_MessageBoxWarning));
+	static const QIcon unknownDataIcon(QApplication::style()->standardIcon(QStyle::SP_MessageBoxQuestion));
 
 	int row = index.row();
 
@@ -28,7 +33,23 @@ QVariant MemPackModel::data(const QModelIndex& index, int role) const
 	{
 		const MemPackItem& item = myItems[row];
 
-		if (role == Qt::DisplayRole)
+		if (item.placeholder)
+		{
+			if (role == Qt::DisplayRole)
+			{
+				return tr("%1\nUnknown data\n%2 blocks").arg(item.title).arg(item.blocks);
+			}
+			else if (role == Qt::DecorationRole)
+			{
+				return unknownDataIcon;
+			}
+			else if (role == Qt::ToolTipRole)
+			{
+				return tr("This data isn't part of any file, but was left over from a deleted or overwritten one.\n"
+				          "It will be saved back unchanged.");
+			}
+		}
+		else if (role == Qt::DisplayRole)
 		{
 			return tr("%1\t%2/%3\n%4 blocks\n%5")
 				.arg(item.title)
@@ -38,9 +59,19 @@ QVariant MemPackModel::data(const QModelIndex& index, int role) const
 		}
 		else if (role == Qt::DecorationRole)
 		{
-			if (item.deleted) return deletedFileIcon;
+			if (item.integrity == MemPackItem::ChecksumBad) return corruptFileIcon;
+			else if (item.deleted) return deletedFileIcon;
 			else return validFileIcon;
 		}
+		else if (role == Qt::ToolTipRole)
+		{
+			if (item.integrity == MemPackItem::ChecksumBad)
+			{
+				return tr("Checksum mismatch: header says %1, data sums to %2.")
+					.arg((quint16)item.header.checksum, 4, 16, QChar('0'))
+					.arg(item.actualChecksum, 4, 16, QChar('0'));
+			}
+		}
 	}
 	
 	return QVariant();
@@ -51,6 +82,9 @@ bool MemPackModel::removeRows(int row, int count, const QModelIndex &parent)
 {
 	if (row < 0 || count < 1) return false;
 
+	// everything after the removed items moves down, and whatever is left at the end gets erased
+	markDirty(itemOffset(row), itemOffset(myItems.size()) - itemOffset(row));
+
 	beginRemoveRows(parent, row, row + count - 1);
 	while (count--)
 	{
@@ -72,6 +106,7 @@ bool MemPackModel::moveRowUp(int row)
 	static const QModelIndex dummy;
 	if (beginMoveRows(dummy, row, row, dummy, row - 1))
 	{
+		markDirty(itemOffset(row - 1), myItems[row - 1].dataSize() + myItems[row].dataSize());
 		myItems.move(row, row - 1);
 		endMoveRows();
 		return true;
@@ -88,6 +123,7 @@ bool MemPackModel::moveRowDown(int row)
 	static const QModelIndex dummy;
 	if (beginMoveRows(dummy, row, row, dummy, row + 2))
 	{
+		markDirty(itemOffset(row), myItems[row].dataSize() + myItems[row + 1].dataSize());
 		myItems.move(row, row + 1);
 		endMoveRows();
 		return true;
@@ -107,9 +143,155 @@ void MemPackModel::setItems(const MemPackItems& newItems)
 {
 	beginResetModel();
 	myItems = newItems;
+	myDirtyBlocks = BlockMap();
+	fullSave = true;
 	endResetModel();
 }
 
+// ----------------------------------------------------------------------------
+void MemPackModel::appendItems(const MemPackItems& newItems)
+{
+	if (newItems.isEmpty()) return;
+
+	beginInsertRows(QModelIndex(), myItems.size(), myItems.size() + newItems.size() - 1);
+	const unsigned offset = itemOffset(myItems.size());
+	myItems += newItems;
+	markDirty(offset, itemOffset(myItems.size()) - offset);
+	endInsertRows();
+}
+
+// ----------------------------------------------------------------------------
+void MemPackModel::reorder(const QVector<int>& order)
+{
+	if (order.size() != myItems.size()) return;
+
+	int firstMoved = 0;
+	while (firstMoved < order.size() && order[firstMoved] == firstMoved)
+	{
+		firstMoved++;
+	}
+	if (firstMoved == order.size()) return;
+
+	emit layoutAboutToBeChanged();
+
+	const QModelIndexList oldIndexes = persistentIndexList();
+	QModelIndexList newIndexes;
+	for (const auto& index : oldIndexes)
+	{
+		newIndexes.append(this->index(order.indexOf(index.row()), 0));
+	}
+
+	MemPackItems newItems;
+	for (int row : order)
+	{
+		newItems.append(myItems[row]);
+	}
+
+	// everything from the first item that moved onwards ends up somewhere else
+	const unsigned offset = itemOffset(firstMoved);
+	markDirty(offset, itemOffset(myItems.size()) - offset);
+	myItems = newItems;
+
+	changePersistentIndexList(oldIndexes, newIndexes);
+	emit layoutChanged();
+}
+
+// ----------------------------------------------------------------------------
+BlockMap MemPackModel::blockMap(BlockMap *placeholderBlocks) const
+{
+	BlockMap blocks;
+	if (placeholderBlocks) *placeholderBlocks = BlockMap();
+
+	unsigned firstBlock = 0;
+	for (const auto& item : myItems)
+	{
+		blocks.setRange(firstBlock, item.blocks);
+		if (placeholderBlocks && item.placeholder)
+		{
+			placeholderBlocks->setRange(firstBlock, item.blocks);
+		}
+		firstBlock += item.blocks;
+	}
+
+	return blocks;
+}
+
+// ----------------------------------------------------------------------------
+unsigned MemPackModel::itemOffset(int row) const
+{
+	unsigned offset = 0;
+	for (int i = 0; i < row && i < myItems.size(); i++)
+	{
+		offset += myItems[i].dataSize();
+	}
+	return offset;
+}
+
+// ----------------------------------------------------------------------------
+unsigned MemPackModel::packSize() const
+{
+	// (items that aren't a whole number of blocks still take up the rest of their last block)
+	const unsigned usedBlocks = qMax<unsigned>(blockMap().findLastSet() + 1,
+		(itemOffset(myItems.size()) + (1 << 17) - 1) >> 17);
+
+	unsigned blocks = 8;
+	while (blocks < usedBlocks)
+	{
+		blocks <<= 1;
+	}
+	return blocks << 17;
+}
+
+// ----------------------------------------------------------------------------
+const BlockMap& MemPackModel::dirtyBlocks() const
+{
+	return myDirtyBlocks;
+}
+
+// ----------------------------------------------------------------------------
+bool MemPackModel::needsFullSave() const
+{
+	return fullSave;
+}
+
+// ----------------------------------------------------------------------------
+void MemPackModel::markLoaded()
+{
+	// only files laid out exactly the way they'd be saved can be updated in place
+	// (i.e. not ones with leftover gaps, mirrored allocations, etc.)
+	unsigned offset = 0;
+	for (const auto& item : myItems)
+	{
+		const int firstBlock = item.sourceBlocks.findFirstSet();
+		if (!item.source || (unsigned)firstBlock << 17 != offset
+			|| item.sourceBlocks.findLastSet() - firstBlock + 1 != (int)item.sourceBlocks.count())
+		{
+			fullSave = true;
+			return;
+		}
+		offset += item.dataSize();
+	}
+
+	myDirtyBlocks = BlockMap();
+	fullSave = false;
+}
+
+// ----------------------------------------------------------------------------
+void MemPackModel::markSaved()
+{
+	myDirtyBlocks = BlockMap();
+	fullSave = false;
+}
+
+// ----------------------------------------------------------------------------
+void MemPackModel::markDirty(unsigned offset, unsigned size)
+{
+	if (!fullSave && size > 0)
+	{
+		myDirtyBlocks.setRange(offset >> 17, ((offset + size - 1) >> 17) - (offset >> 17) + 1);
+	}
+}
+
 // ----------------------------------------------------------------------------
 ItemHeader MemPackModel::itemHeader(unsigned num) const
 {
@@ -126,7 +308,9 @@ void MemPackModel::setItemHeader(unsigned num, const ItemHeader& header)
 {
 	if (num < (unsigned)myItems.size())
 	{
+		// the header is always in the first block of an item
 		myItems[num].header = header;
+		markDirty(itemOffset(num), 1);
 		QModelIndex index = this->index(num, 0);
 		emit dataChanged(index, index);
 	}
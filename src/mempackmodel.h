@@ -20,10 +20,32 @@ public:
 
 	MemPackItems& items();
 	void setItems(const MemPackItems&);
+	void appendItems(const MemPackItems&);
+	// rearranges the items, where order lists the current rows in their new order
+	void reorder(const QVector<int>& order);
+
+	// blocks used by each item when saved in the current order
+	BlockMap blockMap(BlockMap *placeholderBlocks = nullptr) const;
+	unsigned itemOffset(int row) const;
+	// size of the whole pack image when saved, at least 8 blocks and always a power of two
+	unsigned packSize() const;
+
+	// blocks that have changed since the items were last loaded from or saved to a file.
+	// if the whole file needs to be written (e.g. the items didn't come from a file
+	// laid out the same way), this is always empty and needsFullSave() is true
+	const BlockMap& dirtyBlocks() const;
+	bool needsFullSave() const;
+	void markLoaded();
+	void markSaved();
 
 	ItemHeader itemHeader(unsigned) const;
 	void setItemHeader(unsigned, const ItemHeader&);
 
 private:
+	void markDirty(unsigned offset, unsigned size);
+
 	MemPackItems myItems;
+
+	BlockMap myDirtyBlocks;
+	bool fullSave;
 };
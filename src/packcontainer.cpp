@@ -0,0 +1,310 @@
+#include "packcontainer.h"
+#include "blockscan.h"
+#include "endian.h"
+
+#include <qtconcurrentmap.h>
+#include <qendian.h>
+#include <cstring>
+
+#pragma pack(push, 1)
+struct ContainerHeader
+{
+	char     magic[4];
+	uint16le version;
+	uint16le reserved;
+	uint32le packSize;
+	uint32le numBlocks;
+};
+
+struct ContainerBlock
+{
+	uint32le offset;
+	uint32le compressedSize;
+	char     headers[2][0x30];
+};
+#pragma pack(pop)
+
+static const char containerMagic[4] = { 'B', 'S', 'Z', 0x1a };
+static const quint16 containerVersion = 1;
+
+// nothing here is trusted before it's checked against these
+static const unsigned maxBlocks = 1024;
+static const unsigned maxCompressedSize = (1 << 17) + (1 << 12);
+
+// where file headers can be in each block (see MemPackLoader::loadImage)
+static const unsigned headerAreas[2] = { 0x7fb0, 0xffb0 };
+
+// ----------------------------------------------------------------------------
+PackContainer::PackContainer()
+	: device(nullptr)
+	, packSize(0)
+	, cachedBlock(-1)
+{
+}
+
+// ----------------------------------------------------------------------------
+bool PackContainer::isContainer(QIODevice &device)
+{
+	return device.peek(sizeof containerMagic) == QByteArray(containerMagic, sizeof containerMagic);
+}
+
+// ----------------------------------------------------------------------------
+static QByteArray compressBlock(const QByteArray &block)
+{
+	// favor speed, since the erased blocks are most of the savings anyway
+	return qCompress(block, 1);
+}
+
+// ----------------------------------------------------------------------------
+bool PackContainer::write(QIODevice &device, const QByteArray &image)
+{
+	const unsigned numBlocks = (image.size() + (1 << 17) - 1) >> 17;
+
+	QByteArray bitmap((numBlocks + 7) / 8, 0);
+	QList<QByteArray> usedBlocks;
+	QVector<unsigned> usedNumbers;
+
+	for (unsigned i = 0; i < numBlocks; i++)
+	{
+		const QByteArray block = QByteArray::fromRawData(image.constData() + (i << 17),
+			qMin(1 << 17, image.size() - (int)(i << 17)));
+
+		if (isErased(block.constData(), block.size()))
+		{
+			bitmap[i / 8] = bitmap.at(i / 8) | (1 << (i % 8));
+		}
+		else
+		{
+			usedBlocks.append(block);
+			usedNumbers.append(i);
+		}
+	}
+
+	const QList<QByteArray> compressed = QtConcurrent::blockingMapped<QList<QByteArray>>(usedBlocks, compressBlock);
+
+	ContainerHeader header;
+	memcpy(header.magic, containerMagic, sizeof header.magic);
+	header.version = containerVersion;
+	header.reserved = 0;
+	header.packSize = image.size();
+	header.numBlocks = numBlocks;
+
+	bool ok = device.write((const char*)&header, sizeof header) == sizeof header
+		&& device.write(bitmap) == bitmap.size();
+
+	quint32 offset = sizeof header + bitmap.size() + compressed.size() * sizeof(ContainerBlock);
+	for (int i = 0; ok && i < compressed.size(); i++)
+	{
+		const QByteArray &block = usedBlocks[i];
+
+		ContainerBlock entry;
+		entry.offset = offset;
+		entry.compressedSize = compressed[i].size();
+		for (int j = 0; j < 2; j++)
+		{
+			memset(entry.headers[j], 0xff, sizeof entry.headers[j]);
+			if (headerAreas[j] < (unsigned)block.size())
+			{
+				memcpy(entry.headers[j], block.constData() + headerAreas[j],
+					qMin<int>(sizeof entry.headers[j], block.size() - headerAreas[j]));
+			}
+		}
+
+		ok = device.write((const char*)&entry, sizeof entry) == sizeof entry;
+		offset += compressed[i].size();
+	}
+
+	for (int i = 0; ok && i < compressed.size(); i++)
+	{
+		ok = device.write(compressed[i]) == compressed[i].size();
+	}
+
+	return ok;
+}
+
+// ----------------------------------------------------------------------------
+bool PackContainer::open(QIODevice *device)
+{
+	this->device = device;
+	blocks.clear();
+	cachedBlock = -1;
+	cache.clear();
+
+	ContainerHeader header;
+	if (!device->seek(0) || device->read((char*)&header, sizeof header) != sizeof header
+		|| memcmp(header.magic, containerMagic, sizeof header.magic) != 0)
+	{
+		error = "Not a compressed memory pack.";
+		return false;
+	}
+	if (header.version != containerVersion)
+	{
+		error = QString("Unsupported compressed memory pack version (%1).").arg(header.version);
+		return false;
+	}
+
+	packSize = header.packSize;
+	const unsigned numBlocks = header.numBlocks;
+	if (numBlocks > maxBlocks || packSize > numBlocks << 17 || numBlocks != (packSize + (1 << 17) - 1) >> 17)
+	{
+		error = "Compressed memory pack header is invalid.";
+		packSize = 0;
+		return false;
+	}
+
+	const QByteArray bitmap = device->read((numBlocks + 7) / 8);
+	if ((unsigned)bitmap.size() != (numBlocks + 7) / 8)
+	{
+		error = "Compressed memory pack is truncated.";
+		packSize = 0;
+		return false;
+	}
+
+	unsigned storedBlocks = 0;
+	for (unsigned i = 0; i < numBlocks; i++)
+	{
+		if (!(bitmap[i / 8] & (1 << (i % 8)))) storedBlocks++;
+	}
+
+	// every stored block has to be somewhere after the index, and within the file
+	const qint64 fileSize = device->size();
+	const qint64 dataStart = sizeof header + bitmap.size() + (qint64)storedBlocks * sizeof(ContainerBlock);
+
+	blocks.resize(numBlocks);
+	for (unsigned i = 0; i < numBlocks; i++)
+	{
+		Block &block = blocks[i];
+		block.erased = bitmap[i / 8] & (1 << (i % 8));
+		if (block.erased) continue;
+
+		ContainerBlock entry;
+		if (device->read((char*)&entry, sizeof entry) != sizeof entry)
+		{
+			error = "Compressed memory pack is truncated.";
+			blocks.clear();
+			packSize = 0;
+			return false;
+		}
+		if (entry.offset < dataStart || entry.compressedSize < 4 || entry.compressedSize > maxCompressedSize
+			|| (qint64)entry.offset + entry.compressedSize > fileSize)
+		{
+			error = QString("Compressed memory pack is damaged (block %1).").arg(i);
+			blocks.clear();
+			packSize = 0;
+			return false;
+		}
+
+		block.offset = entry.offset;
+		block.compressedSize = entry.compressedSize;
+		memcpy(block.headers, entry.headers, sizeof block.headers);
+	}
+
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+QString PackContainer::errorString() const
+{
+	return error;
+}
+
+// ----------------------------------------------------------------------------
+unsigned PackContainer::size() const
+{
+	return packSize;
+}
+
+// ----------------------------------------------------------------------------
+bool PackContainer::isErased(unsigned block) const
+{
+	return block < (unsigned)blocks.size() && blocks[block].erased;
+}
+
+// ----------------------------------------------------------------------------
+bool PackContainer::readBlock(unsigned block, char *dest) const
+{
+	const Block &entry = blocks[block];
+	const int size = qMin<unsigned>(1 << 17, packSize - (block << 17));
+
+	if (entry.erased)
+	{
+		memset(dest, 0xff, size);
+		return true;
+	}
+
+	if (!device->seek(entry.offset)) return false;
+
+	// qUncompress would allocate however much the stored size asks for, so check it first
+	const QByteArray compressed = device->read(entry.compressedSize);
+	if ((unsigned)compressed.size() != entry.compressedSize
+		|| qFromBigEndian<quint32>((const uchar*)compressed.constData()) != (quint32)size)
+	{
+		return false;
+	}
+
+	const QByteArray data = qUncompress(compressed);
+	if (data.size() != size) return false;
+
+	memcpy(dest, data.constData(), size);
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+bool PackContainer::read(unsigned offset, void *dest, unsigned size) const
+{
+	if (offset > packSize || size > packSize - offset) return false;
+
+	char *out = (char*)dest;
+	while (size > 0)
+	{
+		const unsigned block = offset >> 17;
+		const unsigned blockOffset = offset & ((1 << 17) - 1);
+		const unsigned blockSize = qMin<unsigned>(1 << 17, packSize - (block << 17));
+		const unsigned length = qMin(size, blockSize - blockOffset);
+		const Block &entry = blocks[block];
+
+		if (blockOffset == 0 && length == blockSize)
+		{
+			// whole blocks go straight to where they were asked for
+			if (!readBlock(block, out)) return false;
+		}
+		else if (entry.erased)
+		{
+			memset(out, 0xff, length);
+		}
+		else
+		{
+			// header scans only ever need what's already in the index
+			bool inIndex = false;
+			for (int i = 0; i < 2 && !inIndex; i++)
+			{
+				if (blockOffset >= headerAreas[i] && blockOffset + length <= headerAreas[i] + sizeof entry.headers[i])
+				{
+					memcpy(out, entry.headers[i] + (blockOffset - headerAreas[i]), length);
+					inIndex = true;
+				}
+			}
+
+			if (!inIndex)
+			{
+				if (cachedBlock != (int)block)
+				{
+					cache.resize(blockSize);
+					if (!readBlock(block, cache.data()))
+					{
+						cachedBlock = -1;
+						return false;
+					}
+					cachedBlock = block;
+				}
+				memcpy(out, cache.constData() + blockOffset, length);
+			}
+		}
+
+		out += length;
+		offset += length;
+		size -= length;
+	}
+
+	return true;
+}
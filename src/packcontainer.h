@@ -0,0 +1,51 @@
+#pragma once
+
+#include <qbytearray.h>
+#include <qiodevice.h>
+#include <qvector.h>
+
+// Compressed container for pack images (.bsz). Erased blocks aren't stored at all,
+// and every other block is compressed on its own so it can be read independently.
+// The index also keeps uncompressed copies of the two places in each block where a
+// file header can be, so finding the files in a pack doesn't decompress anything.
+//
+// header:  "BSZ\x1a", version, pack size, number of blocks
+// bitmap:  one bit per block, set if the block is erased
+// index:   for each stored block, its offset, compressed size and header copies
+// data:    the compressed blocks
+class PackContainer
+{
+public:
+	PackContainer();
+
+	static bool isContainer(QIODevice &device);
+	static bool write(QIODevice &device, const QByteArray &image);
+
+	bool open(QIODevice *device);
+	QString errorString() const;
+
+	unsigned size() const;
+	bool isErased(unsigned block) const;
+	// reads from the device given to open(), which the caller makes sure is only used by one thread
+	bool read(unsigned offset, void *dest, unsigned size) const;
+
+private:
+	struct Block
+	{
+		bool erased;
+		quint32 offset;
+		quint32 compressedSize;
+		char headers[2][0x30];
+	};
+
+	bool readBlock(unsigned block, char *dest) const;
+
+	QIODevice *device;
+	QVector<Block> blocks;
+	unsigned packSize;
+	QString error;
+
+	// the last block that had to be decompressed for a partial read
+	mutable int cachedBlock;
+	mutable QByteArray cache;
+};
@@ -0,0 +1,137 @@
+#include "packimage.h"
+
+#include <cstring>
+
+// ----------------------------------------------------------------------------
+PackImage::PackImage()
+	: compressed(false)
+	, mapped(nullptr)
+	, imageSize(0)
+{
+
+}
+
+// ----------------------------------------------------------------------------
+PackImage::PackImage(const QByteArray &data)
+	: compressed(false)
+	, buffer(data)
+	, mapped(nullptr)
+	, imageSize(data.size())
+{
+
+}
+
+// ----------------------------------------------------------------------------
+PackImage::~PackImage()
+{
+	close();
+}
+
+// ----------------------------------------------------------------------------
+bool PackImage::open(const QString &path)
+{
+	close();
+
+	file.setFileName(path);
+	if (!file.open(QIODevice::ReadOnly)) return false;
+
+	if (PackContainer::isContainer(file))
+	{
+		if (!container.open(&file))
+		{
+			file.close();
+			return false;
+		}
+		compressed = true;
+		imageSize = container.size();
+		return true;
+	}
+
+	// map the whole file once instead of seeking and reading it block by block;
+	// this also means only the parts of the file that are actually used get read
+	imageSize = file.size();
+	if (imageSize > 0)
+	{
+		mapped = file.map(0, imageSize);
+	}
+
+	// the mapping stays valid without the file being open, so don't keep holding on to it
+	// (if mapping failed, since not all filesystems support it, the file stays open for read())
+	if (mapped)
+	{
+		file.close();
+	}
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+void PackImage::close()
+{
+	if (mapped)
+	{
+		file.unmap(const_cast<uchar*>(mapped));
+		mapped = nullptr;
+	}
+	file.close();
+	container = PackContainer();
+	compressed = false;
+	buffer.clear();
+	imageSize = 0;
+}
+
+// ----------------------------------------------------------------------------
+QString PackImage::fileName() const
+{
+	return file.fileName();
+}
+
+// ----------------------------------------------------------------------------
+QString PackImage::errorString() const
+{
+	if (!container.errorString().isEmpty()) return container.errorString();
+	return file.errorString();
+}
+
+// ----------------------------------------------------------------------------
+unsigned PackImage::size() const
+{
+	return imageSize;
+}
+
+// ----------------------------------------------------------------------------
+bool PackImage::isCompressed() const
+{
+	return compressed;
+}
+
+// ----------------------------------------------------------------------------
+bool PackImage::isErasedBlock(unsigned block) const
+{
+	// the block list is only changed by open(), so this doesn't need the file lock
+	return compressed && container.isErased(block);
+}
+
+// ----------------------------------------------------------------------------
+const uchar* PackImage::data() const
+{
+	if (mapped) return mapped;
+	if (!buffer.isEmpty()) return (const uchar*)buffer.constData();
+
+	return nullptr;
+}
+
+// ----------------------------------------------------------------------------
+bool PackImage::read(unsigned offset, void *dest, unsigned size) const
+{
+	if (offset > imageSize || size > imageSize - offset) return false;
+
+	if (const uchar *image = data())
+	{
+		memcpy(dest, image + offset, size);
+		return true;
+	}
+
+	QMutexLocker lock(&fileMutex);
+	if (compressed) return container.read(offset, dest, size);
+	return file.seek(offset) && file.read((char*)dest, size) == size;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "packcontainer.h"
+
+#include <qbytearray.h>
+#include <qfile.h>
+#include <qmutex.h>
+#include <qsharedpointer.h>
+
+// Read-only view of a whole memory pack image, either mapped from a file
+// or held in memory (e.g. straight from a USB dump).
+// If a file can't be mapped, it's kept open and read from on demand instead.
+// Compressed packs (see PackContainer) are also read on demand, a block at a time.
+class PackImage
+{
+public:
+	PackImage();
+	explicit PackImage(const QByteArray &data);
+	~PackImage();
+
+	bool open(const QString &path);
+	void close();
+
+	QString fileName() const;
+	QString errorString() const;
+
+	unsigned size() const;
+
+	// compressed images know which blocks are erased without having to read them
+	bool isCompressed() const;
+	bool isErasedBlock(unsigned block) const;
+
+	// direct pointer to the whole image, or null if it has to be read from disk
+	const uchar* data() const;
+	bool read(unsigned offset, void *dest, unsigned size) const;
+
+private:
+	Q_DISABLE_COPY(PackImage)
+
+	mutable QMutex fileMutex;
+	mutable QFile file;
+	PackContainer container;
+	bool compressed;
+	QByteArray buffer;
+	const uchar *mapped;
+	unsigned imageSize;
+};
+
+// loaded items keep their source image alive for as long as they refer to it
+typedef QSharedPointer<const PackImage> PackImagePtr;
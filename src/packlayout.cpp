@@ -0,0 +1,212 @@
+#include "packlayout.h"
+
+// ----------------------------------------------------------------------------
+static unsigned blockCount(const MemPackItem &item)
+{
+	return (item.dataSize() + (1 << 17) - 1) >> 17;
+}
+
+// ----------------------------------------------------------------------------
+static QVector<int> exactFit(const MemPackItems &items, const QVector<int> &rows, unsigned room)
+{
+	// subset sum over the block counts; each total remembers the row that first reached it,
+	// so following them back gives the earliest rows that add up to exactly the room left
+	QVector<int> reachedBy(room + 1, -2);
+	reachedBy[0] = -1;
+
+	for (int i = 0; i < rows.size(); i++)
+	{
+		const unsigned size = blockCount(items[rows[i]]);
+		for (unsigned total = room; total >= size && total > 0; total--)
+		{
+			if (reachedBy[total] == -2 && reachedBy[total - size] != -2)
+			{
+				reachedBy[total] = i;
+			}
+		}
+	}
+
+	QVector<int> chosen;
+	if (reachedBy[room] == -2) return chosen;
+
+	for (unsigned total = room; total > 0; total -= blockCount(items[rows[reachedBy[total]]]))
+	{
+		chosen.prepend(reachedBy[total]);
+	}
+	return chosen;
+}
+
+// ----------------------------------------------------------------------------
+static QVector<int> fitSections(const MemPackItems &items, int first)
+{
+	QVector<int> order, files, placeholders;
+	for (int row = 0; row < items.size(); row++)
+	{
+		if (row == first) continue;
+		(items[row].placeholder ? placeholders : files).append(row);
+	}
+
+	unsigned used = 0;
+	if (first >= 0)
+	{
+		order.append(first);
+		used = blockCount(items[first]);
+	}
+
+	// fill one 32-block section at a time
+	while (!files.isEmpty())
+	{
+		const unsigned room = 32 - (used & 31);
+
+		unsigned remaining = 0;
+		for (int row : files) remaining += blockCount(items[row]);
+
+		// rows that go in this section, preferably filling it exactly so nothing has to cross
+		QVector<int> chosen;
+		if (remaining > room)
+		{
+			const QVector<int> candidates = files + placeholders;
+			for (int i : exactFit(items, candidates, room))
+			{
+				chosen.append(candidates[i]);
+			}
+		}
+		if (chosen.isEmpty())
+		{
+			// no exact fit, so take whatever does fit and pad the rest of the section if possible
+			unsigned free = room;
+			for (int row : files)
+			{
+				const unsigned size = blockCount(items[row]);
+				if (size <= free)
+				{
+					chosen.append(row);
+					free -= size;
+				}
+			}
+
+			// leftover data has no header, so it's free to cross into the next section
+			if (free > 0 && remaining > room - free && !placeholders.isEmpty())
+			{
+				chosen.append(placeholders.first());
+			}
+		}
+		if (chosen.isEmpty())
+		{
+			// nothing left that can avoid crossing into the next section
+			chosen.append(files.first());
+		}
+
+		for (int row : chosen)
+		{
+			order.append(row);
+			used += blockCount(items[row]);
+			files.removeOne(row);
+			placeholders.removeOne(row);
+		}
+	}
+
+	order += placeholders;
+	return order;
+}
+
+// ----------------------------------------------------------------------------
+PackLayout PackLayout::plan(const MemPackItems &items, bool optimize)
+{
+	PackLayout layout;
+
+	QVector<int> order;
+	if (optimize)
+	{
+		int first = -1;
+		for (int row = 0; row < items.size(); row++)
+		{
+			const MemPackItem &item = items[row];
+			if (item.placeholder || item.blocks <= 4) continue;
+
+			if (first < 0 || item.blocks > items[first].blocks)
+			{
+				first = row;
+			}
+		}
+
+		if (first >= 0) order.append(first);
+		for (int row = 0; row < items.size(); row++)
+		{
+			if (row != first && !items[row].placeholder) order.append(row);
+		}
+		for (int row = 0; row < items.size(); row++)
+		{
+			if (items[row].placeholder) order.append(row);
+		}
+
+		layout.setOrder(items, order);
+		if (layout.findSplitFile(items) >= 0)
+		{
+			// only worth moving more files around if it actually makes the pack saveable
+			PackLayout fitted;
+			fitted.setOrder(items, fitSections(items, first));
+			if (fitted.findSplitFile(items) < 0) layout = fitted;
+		}
+	}
+	else
+	{
+		for (int row = 0; row < items.size(); row++)
+		{
+			order.append(row);
+		}
+		layout.setOrder(items, order);
+	}
+
+	return layout;
+}
+
+// ----------------------------------------------------------------------------
+void PackLayout::setOrder(const MemPackItems &items, const QVector<int> &order)
+{
+	this->order = order;
+
+	offsets.resize(items.size());
+	unsigned offset = 0;
+	for (int row : order)
+	{
+		offsets[row] = offset;
+		offset += items[row].dataSize();
+	}
+}
+
+// ----------------------------------------------------------------------------
+bool PackLayout::isListOrder() const
+{
+	for (int i = 0; i < order.size(); i++)
+	{
+		if (order[i] != i) return false;
+	}
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+bool PackLayout::hasMisplacedFiles(const MemPackItems &items) const
+{
+	for (int i = 1; i < order.size(); i++)
+	{
+		const MemPackItem &item = items[order[i]];
+		if (!item.placeholder && item.blocks > 4) return true;
+	}
+	return false;
+}
+
+// ----------------------------------------------------------------------------
+int PackLayout::findSplitFile(const MemPackItems &items) const
+{
+	for (int row : order)
+	{
+		const MemPackItem &item = items[row];
+		if (item.placeholder || !item.dataSize()) continue;
+
+		const unsigned first = offsets[row] >> 17;
+		const unsigned last = (offsets[row] + item.dataSize() - 1) >> 17;
+		if ((first & ~31) != (last & ~31)) return row;
+	}
+	return -1;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <qvector.h>
+#include "mempackitem.h"
+
+// Decides the order items are saved in. Files are always stored back to back,
+// so the order is all there is to where each file ends up.
+struct PackLayout
+{
+	QVector<int> order;        // rows of the items, in the order they're saved
+	QVector<unsigned> offsets; // where each row's item is saved
+
+	// the layout for saving the items as they are, or rearranged to follow the BS-X rules:
+	// the largest file over 4 blocks goes first and leftover data last, with everything
+	// else staying in the same order so as few blocks as possible have to move.
+	// if that would leave a file split across two 32-block sections, the files are
+	// regrouped (and padded with leftover data if possible) so that each one fits in a section
+	static PackLayout plan(const MemPackItems &items, bool optimize);
+
+	bool isListOrder() const;
+	// true if a file that isn't first is too large to be run from PSRAM
+	bool hasMisplacedFiles(const MemPackItems &items) const;
+	// the row of the first file that would be split across two 32-block sections, or -1.
+	// a file's header can only list blocks in the section it starts in, so these can't be saved
+	int findSplitFile(const MemPackItems &items) const;
+
+private:
+	void setOrder(const MemPackItems &items, const QVector<int> &order);
+};
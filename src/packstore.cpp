@@ -0,0 +1,392 @@
+#include "packstore.h"
+#include "mempackloader.h"
+
+#include <qcryptographichash.h>
+#include <qjsonarray.h>
+#include <qjsondocument.h>
+#include <qsavefile.h>
+#include <cstring>
+
+// ----------------------------------------------------------------------------
+static QJsonObject readJson(const QString &path)
+{
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly)) return QJsonObject();
+
+	return QJsonDocument::fromJson(file.readAll()).object();
+}
+
+// ----------------------------------------------------------------------------
+static bool writeJson(const QString &path, const QJsonObject &object)
+{
+	QSaveFile file(path);
+	if (!file.open(QIODevice::WriteOnly)) return false;
+
+	const QByteArray json = QJsonDocument(object).toJson();
+	return file.write(json) == json.size() && file.commit();
+}
+
+// ----------------------------------------------------------------------------
+static QSet<QByteArray> manifestBlobs(const QJsonObject &manifest)
+{
+	QSet<QByteArray> hashes;
+	for (const QJsonValue &value : manifest["items"].toArray())
+	{
+		hashes.insert(QByteArray::fromHex(value.toObject()["blob"].toString().toLatin1()));
+	}
+	for (const QJsonValue &value : manifest["raw"].toArray())
+	{
+		hashes.insert(QByteArray::fromHex(value.toObject()["blob"].toString().toLatin1()));
+	}
+	return hashes;
+}
+
+// ----------------------------------------------------------------------------
+PackStore::PackStore(const QString &root)
+	: root(root)
+{
+}
+
+// ----------------------------------------------------------------------------
+QByteArray PackStore::blobData(const MemPackItem &item)
+{
+	QByteArray data = item.data();
+
+	const unsigned headerPos = item.headerOffset();
+	if (!item.placeholder && headerPos + sizeof item.header <= (unsigned)data.size())
+	{
+		memset(data.data() + headerPos, 0, sizeof item.header);
+	}
+	return data;
+}
+
+// ----------------------------------------------------------------------------
+QByteArray PackStore::blobHash(const MemPackItem &item)
+{
+	return QCryptographicHash::hash(blobData(item), QCryptographicHash::Sha1);
+}
+
+// ----------------------------------------------------------------------------
+QString PackStore::blobPath(const QByteArray &hash) const
+{
+	const QString hex = hash.toHex();
+	return root.filePath(QString("blobs/%1/%2").arg(hex.left(2), hex));
+}
+
+// ----------------------------------------------------------------------------
+QString PackStore::manifestPath(const QString &name) const
+{
+	return root.filePath(QString("packs/%1.json").arg(name));
+}
+
+// ----------------------------------------------------------------------------
+QString PackStore::indexPath(const QByteArray &hash) const
+{
+	const QString hex = hash.toHex();
+	return root.filePath(QString("index/%1/%2").arg(hex.left(2), hex));
+}
+
+// ----------------------------------------------------------------------------
+bool PackStore::updateIndex(const QByteArray &hash, const QString &name, bool contains)
+{
+	// one small file per blob, so adding a pack or looking up a file never touches the rest of the index
+	QStringList names = packsContaining(hash);
+	if (names.contains(name) == contains) return true;
+
+	if (contains) names.append(name);
+	else names.removeAll(name);
+
+	const QString path = indexPath(hash);
+	if (names.isEmpty())
+	{
+		return QFile::remove(path);
+	}
+
+	if (!root.mkpath(QFileInfo(path).path())) return false;
+
+	QSaveFile file(path);
+	const QByteArray data = (names.join('\n') + '\n').toUtf8();
+	return file.open(QIODevice::WriteOnly) && file.write(data) == data.size() && file.commit();
+}
+
+// ----------------------------------------------------------------------------
+QByteArray PackStore::readBlob(const QByteArray &hash, const QHash<QByteArray, QByteArray> &pending) const
+{
+	if (pending.contains(hash)) return pending.value(hash);
+
+	QFile file(blobPath(hash));
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		error = QString("Missing blob %1.").arg(QString(hash.toHex()));
+		return QByteArray();
+	}
+
+	const QByteArray data = file.readAll();
+	if (QCryptographicHash::hash(data, QCryptographicHash::Sha1) != hash)
+	{
+		error = QString("Blob %1 is corrupted.").arg(QString(hash.toHex()));
+		return QByteArray();
+	}
+	return data;
+}
+
+// ----------------------------------------------------------------------------
+bool PackStore::writeBlob(const QByteArray &hash, const QByteArray &data)
+{
+	// anything already stored is identical by definition
+	const QString path = blobPath(hash);
+	if (QFile::exists(path)) return true;
+
+	if (!root.mkpath(QFileInfo(path).path()))
+	{
+		error = QString("Couldn't create %1.").arg(QFileInfo(path).path());
+		return false;
+	}
+
+	QSaveFile file(path);
+	if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit())
+	{
+		error = file.errorString();
+		return false;
+	}
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+QByteArray PackStore::assemble(const QJsonObject &manifest, const QHash<QByteArray, QByteArray> &pending) const
+{
+	const int size = manifest["size"].toInt();
+	if (size < 0)
+	{
+		error = QString("The manifest for %1 is damaged.").arg(manifest["name"].toString());
+		return QByteArray();
+	}
+	QByteArray image(size, (char)0xff);
+
+	// each item's blocks, in the same order they appear in its data
+	for (const QJsonValue &value : manifest["items"].toArray())
+	{
+		const QJsonObject item = value.toObject();
+		const QByteArray blob = readBlob(QByteArray::fromHex(item["blob"].toString().toLatin1()), pending);
+		if (blob.isNull()) return QByteArray();
+
+		const QJsonArray blocks = item["blocks"].toArray();
+		int blobPos = 0;
+		for (const QJsonValue &block : blocks)
+		{
+			if (block.toInt() < 0 || block.toInt() >= (size + (1 << 17) - 1) >> 17) break;
+			const int offset = block.toInt() << 17;
+			const int length = qMin(qMin(1 << 17, blob.size() - blobPos), size - offset);
+			if (length <= 0) break;
+
+			memcpy(image.data() + offset, blob.constData() + blobPos, length);
+			blobPos += length;
+		}
+
+		// the header goes back where it was in the item's first block
+		if (item.contains("header") && !blocks.isEmpty())
+		{
+			const QByteArray header = QByteArray::fromHex(item["header"].toString().toLatin1());
+			const int firstBlock = blocks.first().toInt();
+			const int headerOffset = item["headerOffset"].toInt();
+			const int offset = (qBound(0, firstBlock, size >> 17) << 17) + qBound(0, headerOffset, 1 << 17);
+			if (firstBlock >= 0 && headerOffset >= 0 && offset <= size - header.size())
+			{
+				memcpy(image.data() + offset, header.constData(), header.size());
+			}
+		}
+	}
+
+	// anything that couldn't be described in terms of items is stored block by block
+	for (const QJsonValue &value : manifest["raw"].toArray())
+	{
+		const QJsonObject raw = value.toObject();
+		const QByteArray blob = readBlob(QByteArray::fromHex(raw["blob"].toString().toLatin1()), pending);
+		if (blob.isNull()) return QByteArray();
+
+		// (the last block may be a partial one, but nothing may go outside the image)
+		const int block = raw["block"].toInt();
+		if (block < 0 || block > (size >> 17) || blob.size() > (1 << 17) || (block << 17) > size - blob.size())
+		{
+			error = QString("The manifest for %1 is damaged.").arg(manifest["name"].toString());
+			return QByteArray();
+		}
+		memcpy(image.data() + (block << 17), blob.constData(), blob.size());
+	}
+
+	return image;
+}
+
+// ----------------------------------------------------------------------------
+QString PackStore::addPack(const QString &path, QString name)
+{
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		error = QString("%1: %2").arg(path, file.errorString());
+		return QString();
+	}
+	const QByteArray original = file.readAll();
+	file.close();
+
+	const QString source = QFileInfo(path).absoluteFilePath();
+	const QString sha1 = QCryptographicHash::hash(original, QCryptographicHash::Sha1).toHex();
+
+	if (name.isEmpty())
+	{
+		// packs in different folders can have the same file name, so only replace a pack
+		// that came from the same file (or is identical anyway), and number the others
+		const QString baseName = QFileInfo(path).completeBaseName();
+		name = baseName;
+		for (int num = 2; QFile::exists(manifestPath(name)); num++)
+		{
+			const QJsonObject existing = readJson(manifestPath(name));
+			if (existing["source"].toString() == source || existing["sha1"].toString() == sha1) break;
+
+			name = QString("%1 (%2)").arg(baseName).arg(num);
+		}
+	}
+
+	const MemPackLoadResult result = MemPackLoader::loadImage(PackImagePtr(new PackImage(original)));
+
+	QJsonObject manifest;
+	manifest["name"] = name;
+	manifest["source"] = source;
+	manifest["size"] = original.size();
+	manifest["sha1"] = sha1;
+
+	QHash<QByteArray, QByteArray> pending;
+	QJsonArray items;
+	for (const MemPackItem &item : result.items)
+	{
+		const QByteArray data = blobData(item);
+		const QByteArray hash = QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+		pending.insert(hash, data);
+
+		QJsonObject entry;
+		entry["blob"] = QString(hash.toHex());
+		entry["title"] = item.title;
+
+		QJsonArray blocks;
+		for (int i = item.sourceBlocks.findFirstSet(); i >= 0; i = item.sourceBlocks.findFirstSet(i + 1))
+		{
+			blocks.append(i);
+		}
+		entry["blocks"] = blocks;
+
+		if (!item.placeholder)
+		{
+			const QByteArray itemData = item.dataView();
+			entry["headerOffset"] = (int)item.headerOffset();
+			entry["header"] = QString(itemData.mid(item.headerOffset(), sizeof item.header).toHex());
+		}
+		items.append(entry);
+	}
+	manifest["items"] = items;
+
+	// whatever doesn't match after putting the items back together (partial blocks at the end,
+	// files overlapping each other, etc.) is stored as is, so the result is always exact
+	const QByteArray rebuilt = assemble(manifest, pending);
+	const bool rebuiltAll = rebuilt.size() == original.size();
+
+	QJsonArray raw;
+	for (int offset = 0; offset < original.size(); offset += 1 << 17)
+	{
+		const int length = qMin(1 << 17, original.size() - offset);
+		if (!rebuiltAll || memcmp(original.constData() + offset, rebuilt.constData() + offset, length) != 0)
+		{
+			const QByteArray block = original.mid(offset, length);
+			const QByteArray hash = QCryptographicHash::hash(block, QCryptographicHash::Sha1);
+			pending.insert(hash, block);
+
+			QJsonObject entry;
+			entry["block"] = offset >> 17;
+			entry["blob"] = QString(hash.toHex());
+			raw.append(entry);
+		}
+	}
+	manifest["raw"] = raw;
+
+	for (auto i = pending.constBegin(); i != pending.constEnd(); i++)
+	{
+		if (!writeBlob(i.key(), i.value())) return QString();
+	}
+
+	// whatever was stored under this name before is being replaced
+	const QSet<QByteArray> oldBlobs = manifestBlobs(readJson(manifestPath(name)));
+
+	if (!root.mkpath("packs") || !writeJson(manifestPath(name), manifest))
+	{
+		error = QString("Couldn't write the manifest for %1.").arg(name);
+		return QString();
+	}
+
+	// update the reverse lookup last, so it never refers to a pack that wasn't stored
+	bool ok = true;
+	for (auto i = pending.constBegin(); i != pending.constEnd(); i++)
+	{
+		ok &= updateIndex(i.key(), name, true);
+	}
+	for (const QByteArray &hash : oldBlobs)
+	{
+		if (!pending.contains(hash)) ok &= updateIndex(hash, name, false);
+	}
+
+	if (!ok)
+	{
+		error = QString("Couldn't update the index for %1.").arg(name);
+		return QString();
+	}
+
+	return name;
+}
+
+// ----------------------------------------------------------------------------
+QByteArray PackStore::rebuildPack(const QString &name) const
+{
+	const QJsonObject manifest = readJson(manifestPath(name));
+	if (manifest.isEmpty())
+	{
+		error = QString("No pack named %1 in the store.").arg(name);
+		return QByteArray();
+	}
+
+	const QByteArray image = assemble(manifest, QHash<QByteArray, QByteArray>());
+	if (image.isNull()) return image;
+
+	if (QString(QCryptographicHash::hash(image, QCryptographicHash::Sha1).toHex()) != manifest["sha1"].toString())
+	{
+		error = QString("%1 didn't rebuild correctly.").arg(name);
+		return QByteArray();
+	}
+
+	return image;
+}
+
+// ----------------------------------------------------------------------------
+QStringList PackStore::packs() const
+{
+	QStringList names;
+	for (const QFileInfo &info : QDir(root.filePath("packs")).entryInfoList(QStringList() << "*.json", QDir::Files, QDir::Name))
+	{
+		names.append(info.completeBaseName());
+	}
+	return names;
+}
+
+// ----------------------------------------------------------------------------
+QStringList PackStore::packsContaining(const QByteArray &blobHash) const
+{
+	QFile file(indexPath(blobHash));
+	if (!file.open(QIODevice::ReadOnly)) return QStringList();
+
+	QStringList names = QString::fromUtf8(file.readAll()).split('\n');
+	names.removeAll(QString());
+	return names;
+}
+
+// ----------------------------------------------------------------------------
+QString PackStore::errorString() const
+{
+	return error;
+}
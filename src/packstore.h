@@ -0,0 +1,51 @@
+#pragma once
+
+#include <qdir.h>
+#include <qhash.h>
+#include <qjsonobject.h>
+#include <qset.h>
+#include <qstringlist.h>
+#include "mempackitem.h"
+
+// Deduplicated storage for a library of pack images. Each file's data is stored once
+// as a blob named after its SHA-1, and each pack is just a small manifest of which
+// blobs go where. Packs can be rebuilt byte for byte from their manifests.
+//
+// <root>/blobs/ab/abcdef...  file data, with the header area zeroed out
+// <root>/packs/<name>.json   manifest for one pack
+// <root>/index/ab/abcdef...  names of the packs a blob appears in, one per line
+class PackStore
+{
+public:
+	explicit PackStore(const QString &root);
+
+	// adds a pack under the given name, replacing any pack already stored under it.
+	// without a name, the file name is used (numbered if a different pack already has it).
+	// returns the name the pack was stored under, or an empty string on error
+	QString addPack(const QString &path, QString name = QString());
+	QByteArray rebuildPack(const QString &name) const;
+
+	QStringList packs() const;
+	QStringList packsContaining(const QByteArray &blobHash) const;
+
+	// the hash a file's data is stored under. headers are kept separately,
+	// so copies of a file that only differ in play count, position, etc. share a blob
+	static QByteArray blobHash(const MemPackItem &item);
+
+	QString errorString() const;
+
+private:
+	static QByteArray blobData(const MemPackItem &item);
+	QString blobPath(const QByteArray &hash) const;
+	QString manifestPath(const QString &name) const;
+	QString indexPath(const QByteArray &hash) const;
+
+	bool updateIndex(const QByteArray &hash, const QString &name, bool contains);
+
+	QByteArray readBlob(const QByteArray &hash, const QHash<QByteArray, QByteArray> &pending) const;
+	bool writeBlob(const QByteArray &hash, const QByteArray &data);
+	QByteArray assemble(const QJsonObject &manifest, const QHash<QByteArray, QByteArray> &pending) const;
+
+	QDir root;
+	mutable QString error;
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <qobject.h>
+#include <qatomic.h>
 #include <exception>
 
 class USBDevice : public QObject
@@ -14,6 +15,20 @@ public:
 		INLRetro,
 	};
 
+	// lets another thread abort a transfer that is in progress
+	class CancelToken
+	{
+	public:
+		CancelToken() : cancelled(0) {}
+
+		void cancel() { cancelled.storeRelease(1); }
+		void reset()  { cancelled.storeRelease(0); }
+		bool isCancelled() const { return cancelled.loadAcquire() != 0; }
+
+	private:
+		QAtomicInt cancelled;
+	};
+
 	USBDevice(quint16 vid, quint16 pid, QObject *parent = nullptr);
 	virtual ~USBDevice();
 
@@ -21,11 +36,13 @@ public:
 	virtual void close();
 
 	virtual quint8 readByte(quint8 bank, quint16 addr, bool *ok = nullptr) = 0;
-	virtual QByteArray readBytes(quint8 bank, quint16 addr, unsigned size, bool *ok = nullptr) = 0;
+	virtual QByteArray readBytes(quint8 bank, quint16 addr, unsigned size, bool *ok = nullptr,
+		const CancelToken *cancel = nullptr) = 0;
 	virtual bool writeByte(quint8 bank, quint16 addr, quint8 data) = 0;
 
 signals:
 	void usbLogMessage(const QString&);
+	void readProgress(unsigned bytesRead, unsigned size);
 
 protected:
 
@@ -1,6 +1,7 @@
 #include "inlretro.h"
 
 #include <QThread>
+#include <QElapsedTimer>
 
 enum INLRequest {
 	requestIO         = 0x02,
@@ -114,7 +115,8 @@ quint8 INLRetroDevice::readByte(quint8 bank, quint16 addr, bool *ok)
 }
 
 // ----------------------------------------------------------------------------
-QByteArray INLRetroDevice::readBytes(quint8 bank, quint16 addr, unsigned size, bool *ok)
+QByteArray INLRetroDevice::readBytes(quint8 bank, quint16 addr, unsigned size, bool *ok,
+	const CancelToken *cancel)
 {
 	bool bOk = false;
 	QByteArray readData;
@@ -124,8 +126,7 @@ QByteArray INLRetroDevice::readBytes(quint8 bank, quint16 addr, unsigned size, b
 		setBank(bank);
 
 		// reset buffers
-		writeControlPacket(requestOperation, SET_OPERATION, OPERATION_RESET);
-		writeControlPacket(requestBuffer,    RAW_BUFFER_RESET, 0);
+		resetOperation();
 
 		// initialize buffers for 128 byte reads
 		// buffer 0: id 0x00, bank offset 0x00, reload 1
@@ -146,12 +147,22 @@ QByteArray INLRetroDevice::readBytes(quint8 bank, quint16 addr, unsigned size, b
 		// start dump
 		writeControlPacket(requestOperation, SET_OPERATION, OPERATION_STARTDUMP);
 
+		// progress goes to other threads, so only report it every so often instead of every payload
+		QElapsedTimer progressTimer;
+		progressTimer.start();
+
+		readData.reserve(size);
 		while (readData.size() < size)
 		{
 			// wait for read buffer
 			unsigned waitCount = 0;
 			while (true)
 			{
+				if (cancel && cancel->isCancelled())
+				{
+					throw USBException(tr("Transfer cancelled"));
+				}
+
 				writeControlPacket(requestBuffer, GET_CUR_BUFF_STATUS, 0, 3);
 				if (this->inData.size() < 3 || this->inData[2] != (char)STATUS_DUMPED)
 				{
@@ -170,17 +181,33 @@ QByteArray INLRetroDevice::readBytes(quint8 bank, quint16 addr, unsigned size, b
 			// get data (no return value, only data)
 			USBDevice::writeControlPacket(requestBuffer, BUFF_PAYLOAD, 0, 128);
 			readData += this->inData;
+
+			if ((unsigned)readData.size() >= size || progressTimer.elapsed() >= 50)
+			{
+				emit readProgress(qMin((unsigned)readData.size(), size), size);
+				progressTimer.restart();
+			}
 		}
 
 		// we're finished; get out of dump mode again
-		writeControlPacket(requestOperation, SET_OPERATION, OPERATION_RESET);
-		writeControlPacket(requestBuffer, RAW_BUFFER_RESET, 0);
+		resetOperation();
 
 		bOk = true;
 	}
 	catch (USBException &e)
 	{
-		emit usbLogMessage(e.what());
+		// a cancelled transfer is reported by the caller instead
+		if (!cancel || !cancel->isCancelled())
+		{
+			emit usbLogMessage(e.what());
+		}
+
+		// don't leave the programmer stuck in dump mode
+		try
+		{
+			resetOperation();
+		}
+		catch (USBException&) {}
 	}
 
 	if (ok) *ok = bOk;
@@ -220,6 +247,13 @@ void INLRetroDevice::setBank(quint8 bank)
 	}
 }
 
+// ----------------------------------------------------------------------------
+void INLRetroDevice::resetOperation()
+{
+	writeControlPacket(requestOperation, SET_OPERATION, OPERATION_RESET);
+	writeControlPacket(requestBuffer,    RAW_BUFFER_RESET, 0);
+}
+
 // ----------------------------------------------------------------------------
 void INLRetroDevice::writeControlPacket(quint8 bRequest, quint16 wValue, quint16 wIndex, quint16 wLength)
 {
@@ -13,11 +13,13 @@ public:
 	bool open();
 
 	quint8 readByte(quint8 bank, quint16 addr, bool *ok = nullptr);
-	QByteArray readBytes(quint8 bank, quint16 addr, unsigned size, bool *ok = nullptr);
+	QByteArray readBytes(quint8 bank, quint16 addr, unsigned size, bool *ok = nullptr,
+		const CancelToken *cancel = nullptr);
 	bool writeByte(quint8 bank, quint16 addr, quint8 data);
 
 private:
 	void setBank(quint8 bank);
+	void resetOperation();
 	void writeControlPacket(quint8 bRequest, quint16 wValue, quint16 wIndex, quint16 wLength = 1);
 
 	quint8 currentBank;
@@ -1,19 +1,16 @@
 
 #include "usbdump.h"
-#include "usb/inlretro.h"
 
-#include <qmessagebox.h>
+#include <qapplication.h>
 #include <qfiledialog.h>
 #include <qdebug.h>
 
-// uncomment to try to detect valid flash memory
-//#define DETECT_MEMORY_PACK
-
 // ----------------------------------------------------------------------------
 USBDumpDialog::USBDumpDialog(USBDevice::DeviceType deviceType, QWidget *parent)
 	: QDialog(parent)
 	, deviceType(deviceType)
 	, dumpThread(nullptr)
+	, dumpSaved(false)
 {
 	ui.setupUi(this);
 
@@ -26,17 +23,33 @@ USBDumpDialog::USBDumpDialog(USBDevice::DeviceType deviceType, QWidget *parent)
 
 	showMessage(tr("Press Start to begin dumping."));
 	showMessage(tr("If the file is dumped successfully, it will be automatically opened in the main window."));
+	showMessage(tr("Leave the output path empty to open the dump without saving it to disk."));
 }
 
 // ----------------------------------------------------------------------------
-QString USBDumpDialog::dump()
+bool USBDumpDialog::dump()
 {
-	if (this->browse() && this->exec())
-	{
-		return ui.editOutputPath->text();
-	}
+	dumpImage.clear();
+	dumpSaved = false;
+	return this->exec() == QDialog::Accepted;
+}
+
+// ----------------------------------------------------------------------------
+const QByteArray& USBDumpDialog::image() const
+{
+	return dumpImage;
+}
+
+// ----------------------------------------------------------------------------
+QString USBDumpDialog::outputPath() const
+{
+	return ui.editOutputPath->text();
+}
 
-	return QString();
+// ----------------------------------------------------------------------------
+bool USBDumpDialog::saved() const
+{
+	return dumpSaved;
 }
 
 // ----------------------------------------------------------------------------
@@ -69,12 +82,6 @@ bool USBDumpDialog::browse()
 void USBDumpDialog::startDump()
 {
 	QString outPath = ui.editOutputPath->text();
-	if (outPath.isEmpty())
-	{
-		QMessageBox::warning(this, this->windowTitle(),
-			tr("Output file name cannot be empty."));
-		return;
-	}
 
 	// UI setup to start dumping
 	ui.editOutputPath->setEnabled(false);
@@ -87,6 +94,7 @@ void USBDumpDialog::startDump()
 
 	connect(dumpThread, SIGNAL(showMessage(QString)), this, SLOT(showMessage(QString)));
 	connect(dumpThread, SIGNAL(dumpProgress(int, int)), this, SLOT(setProgress(int, int)));
+	connect(dumpThread, SIGNAL(dumpSpeed(double, double, int)), this, SLOT(setSpeed(double, double, int)));
 	connect(dumpThread, SIGNAL(dumpFinished()), this, SLOT(accept()));
 
 	dumpThread->start();
@@ -95,6 +103,8 @@ void USBDumpDialog::startDump()
 		qApp->processEvents();
 	}
 
+	dumpImage = dumpThread->image();
+	dumpSaved = dumpThread->saved();
 	delete dumpThread;
 	dumpThread = nullptr;
 
@@ -104,6 +114,7 @@ void USBDumpDialog::startDump()
 	ui.buttonStartDump->show();
 	ui.buttonCancel->hide();
 	ui.progressBar->setRange(0, 1);
+	ui.progressBar->setFormat("%p%");
 	ui.progressBar->setTextVisible(false);
 }
 
@@ -112,7 +123,7 @@ void USBDumpDialog::cancelDump()
 {
 	if (dumpThread != nullptr)
 	{
-		dumpThread->requestInterruption();
+		dumpThread->cancel();
 	}
 }
 
@@ -125,126 +136,17 @@ void USBDumpDialog::setProgress(int val, int max)
 }
 
 // ----------------------------------------------------------------------------
-void USBDumpDialog::showMessage(const QString& msg)
-{
-	qDebug() << msg;
-	ui.editDumpLog->appendPlainText(msg);
-}
-
-// ----------------------------------------------------------------------------
-USBDumpThread::USBDumpThread(USBDevice::DeviceType deviceType, const QString &outPath, QObject *parent)
-	: QThread(parent)
-	, outPath(outPath)
+void USBDumpDialog::setSpeed(double current, double average, int secondsLeft)
 {
-	switch (deviceType)
-	{
-	case USBDevice::INLRetro:
-		this->usbDevice = new INLRetroDevice(this);
-		break;
-
-	default:
-		this->usbDevice = nullptr;
-	}
-
-	if (this->usbDevice)
-	{
-		connect(this->usbDevice, SIGNAL(usbLogMessage(QString)), this, SIGNAL(showMessage(QString)));
-	}
+	ui.progressBar->setFormat(tr("%p% - %1 KB/s (average %2 KB/s), %3 s left")
+		.arg(current / 1024, 0, 'f', 1)
+		.arg(average / 1024, 0, 'f', 1)
+		.arg(secondsLeft));
 }
 
 // ----------------------------------------------------------------------------
-void USBDumpThread::run()
+void USBDumpDialog::showMessage(const QString& msg)
 {
-	QFile file(outPath);
-
-	bool ok = true;
-
-	if (this->usbDevice->open() && file.open(QFile::WriteOnly))
-	{
-		emit showMessage(tr("USB device opened successfully."));
-
-#ifdef DETECT_MEMORY_PACK
-		// first try to detect memory pack
-
-		// memory pack write enable
-		this->usbDevice->writeByte(0x0c, 0x5000, 0x80);
-		this->usbDevice->writeByte(0x0e, 0x5000, 0x00);
-
-		// restore default page buffer settings
-		this->usbDevice->writeByte(0xc0, 0x0000, 0x38);
-		this->usbDevice->writeByte(0xc0, 0x0000, 0xd0);
-
-		// swap in the vendor info page in the flash chip and see what we find
-		this->usbDevice->writeByte(0xc0, 0x0000, 0x72);
-		this->usbDevice->writeByte(0xc0, 0x0000, 0x75);
-		QByteArray flashInfo = this->usbDevice->readBytes(0xc0, 0xff00, 16);
-		this->usbDevice->writeByte(0xc0, 0x0000, 0xff);
-
-		// memory pack write disable
-		this->usbDevice->writeByte(0x0c, 0x5000, 0x00);
-		this->usbDevice->writeByte(0x0e, 0x5000, 0x00);
-
-		if (flashInfo.size() < 16
-			|| flashInfo[0] != 'M'
-			|| flashInfo[2] != 'P'
-			|| flashInfo[4] & 0x80)
-		{
-			emit showMessage(tr("No valid memory pack detected."));
-			ok = false;
-		}
-
-		quint8 flashType = (uchar)flashInfo[6] >> 4;
-		quint8 flashSize = 2 << (((uchar)flashInfo[6] & 0x0f) - 8);
-
-		if (ok) {
-			if (flashSize > 32)
-			{
-				qDebug() << "warning: bogus flash size" << flashSize << "blocks";
-				flashSize = 8;
-			}
-			emit showMessage(tr("Type %1 memory pack detected, %2 blocks.").arg(flashType).arg(flashSize));
-		}
-#else
-		quint8 flashSize = 8;
-#endif
-
-		for (unsigned i = 0; ok && i < flashSize << 1; i++)
-		{
-			if (!(i & 1))
-			{
-				emit showMessage(tr("Dumping block %1 of %2...").arg((i >> 1) + 1).arg(flashSize));
-			}
-
-			emit dumpProgress(i, flashSize << 1);
-			file.write(this->usbDevice->readBytes(0xc0 + i, 0x0000, 1 << 16, &ok));
-
-			yieldCurrentThread();
-			if (this->isInterruptionRequested())
-			{
-				ok = false;
-			}
-		}
-		if (this->isInterruptionRequested())
-		{
-			emit showMessage(tr("Dump cancelled."));
-		}
-		else if (ok)
-		{
-			emit showMessage(tr("Full file dumped successfully."));
-
-			emit dumpFinished();
-		}
-		else
-		{
-			emit showMessage(tr("File dump failed."));
-		}
-	}
-	else
-	{
-		emit showMessage(tr("USB device open failed."));
-		ok = false;
-	}
-
-	this->usbDevice->close();
-
+	qDebug() << msg;
+	ui.editDumpLog->appendPlainText(msg);
 }
@@ -1,11 +1,8 @@
 #pragma once
 
 #include <QtWidgets/QDialog>
-#include <qthread.h>
 #include "ui_usbdump.h"
-#include "usb/device.h"
-
-class USBDumpThread;
+#include "dumpthread.h"
 
 class USBDumpDialog : public QDialog
 {
@@ -16,7 +13,11 @@ public:
 	USBDumpDialog(USBDevice::DeviceType deviceType, QWidget *parent = Q_NULLPTR);
 	~USBDumpDialog() {}
 	
-	QString dump();
+	bool dump();
+
+	const QByteArray& image() const;
+	QString outputPath() const;
+	bool saved() const;
 
 public slots:
 	void reject();
@@ -28,31 +29,13 @@ private slots:
 	void cancelDump();
 
 	void setProgress(int val, int max);
+	void setSpeed(double current, double average, int secondsLeft);
 	void showMessage(const QString&);
 
 private:
 	USBDevice::DeviceType deviceType;
 	USBDumpThread *dumpThread;
+	QByteArray dumpImage;
+	bool dumpSaved;
 	Ui::USBDumpDialog ui;
 };
-
-class USBDumpThread : public QThread
-{
-	Q_OBJECT
-
-public:
-	USBDumpThread(USBDevice::DeviceType deviceType, const QString &outPath, QObject *parent = Q_NULLPTR);
-
-signals:
-	void showMessage(const QString&);
-
-	void dumpProgress(int val, int max);
-	void dumpFinished();
-
-protected:
-	void run();
-
-private:
-	QString outPath;
-	USBDevice *usbDevice;
-};
@@ -0,0 +1,178 @@
+#include "zipwriter.h"
+#include "crc32.h"
+#include "endian.h"
+
+#pragma pack(push, 1)
+struct ZipLocalHeader
+{
+	uint32le signature; // 0x04034b50
+	uint16le versionNeeded;
+	uint16le flags;
+	uint16le method;
+	uint16le time;
+	uint16le date;
+	uint32le crc;
+	uint32le compressedSize;
+	uint32le size;
+	uint16le nameLength;
+	uint16le extraLength;
+};
+
+struct ZipCentralHeader
+{
+	uint32le signature; // 0x02014b50
+	uint16le versionMadeBy;
+	uint16le versionNeeded;
+	uint16le flags;
+	uint16le method;
+	uint16le time;
+	uint16le date;
+	uint32le crc;
+	uint32le compressedSize;
+	uint32le size;
+	uint16le nameLength;
+	uint16le extraLength;
+	uint16le commentLength;
+	uint16le diskStart;
+	uint16le internalAttributes;
+	uint32le externalAttributes;
+	uint32le offset;
+};
+
+struct ZipEndRecord
+{
+	uint32le signature; // 0x06054b50
+	uint16le diskNumber;
+	uint16le centralDisk;
+	uint16le diskEntries;
+	uint16le totalEntries;
+	uint32le centralSize;
+	uint32le centralOffset;
+	uint16le commentLength;
+};
+#pragma pack(pop)
+
+static const quint16 zipVersion = 20;     // 2.0, for deflate
+static const quint16 zipFlagUTF8 = 1 << 11;
+
+// ----------------------------------------------------------------------------
+ZipWriter::ZipWriter(QIODevice *device)
+	: device(device)
+	, ok(true)
+{
+	// every entry gets the time the archive was made
+	const QDateTime now = QDateTime::currentDateTime();
+	dosTime = (now.time().hour() << 11) | (now.time().minute() << 5) | (now.time().second() / 2);
+	dosDate = ((now.date().year() - 1980) << 9) | (now.date().month() << 5) | now.date().day();
+}
+
+// ----------------------------------------------------------------------------
+ZipWriter::Entry ZipWriter::compress(const QString &name, const QByteArray &data)
+{
+	Entry entry;
+	entry.name = name;
+	entry.crc = CRC32::hash(data);
+	entry.size = data.size();
+
+	// qCompress gives a zlib stream with a 4-byte length in front; zip only wants the raw
+	// deflate data in between the 2-byte zlib header and the 4-byte adler32 at the end
+	const QByteArray compressed = qCompress(data);
+	if (compressed.size() > 10 && compressed.size() - 10 < data.size())
+	{
+		entry.data = compressed.mid(6, compressed.size() - 10);
+		entry.deflated = true;
+	}
+	else
+	{
+		entry.data = data;
+		entry.deflated = false;
+	}
+
+	return entry;
+}
+
+// ----------------------------------------------------------------------------
+bool ZipWriter::addEntry(const Entry &entry)
+{
+	if (!ok) return false;
+
+	Written written;
+	written.name = entry.name.toUtf8();
+	written.deflated = entry.deflated;
+	written.crc = entry.crc;
+	written.compressedSize = entry.data.size();
+	written.size = entry.size;
+	written.offset = device->pos();
+
+	ZipLocalHeader header;
+	header.signature = 0x04034b50;
+	header.versionNeeded = zipVersion;
+	header.flags = zipFlagUTF8;
+	header.method = entry.deflated ? 8 : 0;
+	header.time = dosTime;
+	header.date = dosDate;
+	header.crc = written.crc;
+	header.compressedSize = written.compressedSize;
+	header.size = written.size;
+	header.nameLength = written.name.size();
+	header.extraLength = 0;
+
+	ok = device->write((const char*)&header, sizeof header) == sizeof header
+		&& device->write(written.name) == written.name.size()
+		&& device->write(entry.data) == entry.data.size();
+
+	entries.append(written);
+	return ok;
+}
+
+// ----------------------------------------------------------------------------
+bool ZipWriter::finish()
+{
+	if (!ok) return false;
+
+	const quint32 centralOffset = device->pos();
+
+	for (const Written &written : entries)
+	{
+		ZipCentralHeader header;
+		header.signature = 0x02014b50;
+		header.versionMadeBy = zipVersion;
+		header.versionNeeded = zipVersion;
+		header.flags = zipFlagUTF8;
+		header.method = written.deflated ? 8 : 0;
+		header.time = dosTime;
+		header.date = dosDate;
+		header.crc = written.crc;
+		header.compressedSize = written.compressedSize;
+		header.size = written.size;
+		header.nameLength = written.name.size();
+		header.extraLength = 0;
+		header.commentLength = 0;
+		header.diskStart = 0;
+		header.internalAttributes = 0;
+		header.externalAttributes = 0;
+		header.offset = written.offset;
+
+		ok &= device->write((const char*)&header, sizeof header) == sizeof header
+			&& device->write(written.name) == written.name.size();
+	}
+
+	ZipEndRecord end;
+	end.signature = 0x06054b50;
+	end.diskNumber = 0;
+	end.centralDisk = 0;
+	end.diskEntries = entries.size();
+	end.totalEntries = entries.size();
+	end.centralSize = device->pos() - centralOffset;
+	end.centralOffset = centralOffset;
+	end.commentLength = 0;
+
+	ok &= device->write((const char*)&end, sizeof end) == sizeof end;
+	return ok;
+}
+
+// ----------------------------------------------------------------------------
+QString ZipWriter::errorString() const
+{
+	return device->errorString();
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <qbytearray.h>
+#include <qdatetime.h>
+#include <qiodevice.h>
+#include <qvector.h>
+
+// Writes a zip archive to a device in one pass, one entry at a time.
+// Each entry is compressed in memory before it's written, so the device never needs to seek.
+class ZipWriter
+{
+public:
+	explicit ZipWriter(QIODevice *device);
+
+	// compressing is the slow part and doesn't touch the writer, so it can be done on any thread
+	struct Entry
+	{
+		QString name;
+		QByteArray data; // deflated, or stored as-is if that turned out smaller
+		bool deflated;
+		quint32 crc;
+		quint32 size;
+	};
+	static Entry compress(const QString &name, const QByteArray &data);
+
+	bool addEntry(const Entry &entry);
+	// writes the central directory; the archive isn't valid until this is done
+	bool finish();
+
+	QString errorString() const;
+
+private:
+	struct Written
+	{
+		QByteArray name;
+		bool deflated;
+		quint32 crc;
+		quint32 compressedSize;
+		quint32 size;
+		quint32 offset;
+	};
+
+	QIODevice *device;
+	QVector<Written> entries;
+	quint16 dosTime, dosDate;
+	bool ok;
+};